@@ -0,0 +1,153 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// Compares the plain text search paths: QTextDocument::find() (which Find
+// Next used), QString::indexOf() (which the live search used), and
+// SyntaxTextEdit::findMatches() with the LiteralSearch kernel.  Also checks
+// that all three find the same matches.
+//
+// Usage: literalsearch_bench [size in MiB]
+
+#include "syntaxtextedit.h"
+#include "literalsearch.h"
+
+#include <QCoreApplication>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QRegularExpression>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+#define BENCH_ITERATIONS    3
+
+// Something like a server log, with the occasional exception in it
+static QString makeLog(size_t size, std::mt19937 &rng)
+{
+    static const char *const messages[] = {
+        "INFO  [worker-%d] Request %d completed in %d ms\n",
+        "DEBUG [worker-%d] Cache lookup for key %d returned %d entries\n",
+        "WARN  [worker-%d] Slow query (%d rows) took %d ms\n",
+        "INFO  [scheduler] Job %d queued behind %d others, retry %d\n",
+    };
+    std::uniform_int_distribution<size_t> pick(0, sizeof(messages) / sizeof(messages[0]) - 1);
+    std::uniform_int_distribution<int> number(0, 99999);
+    std::uniform_int_distribution<int> rare(0, 20000);
+    QString out;
+    out.reserve(static_cast<int>(size) + 256);
+    char line[256];
+    while (static_cast<size_t>(out.size()) < size) {
+        std::snprintf(line, sizeof(line), messages[pick(rng)],
+                      number(rng) % 16, number(rng), number(rng));
+        out += QLatin1String("2024-05-01 12:00:00.000 ");
+        out += QLatin1String(line);
+        if (rare(rng) == 0)
+            out += QLatin1String("ERROR [worker-3] java.lang.OutOfMemoryError: Java heap space\n");
+    }
+    return out;
+}
+
+static double bestTime(const std::function<void ()> &func)
+{
+    double best = 1e9;
+    for (int i = 0; i < BENCH_ITERATIONS; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+static void benchSearch(QTextDocument *document, const QString &text,
+                        const QString &pattern, bool caseSensitive)
+{
+    SyntaxTextEdit::SearchParams params;
+    params.searchText = pattern;
+    params.caseSensitive = caseSensitive;
+
+    const QTextDocument::FindFlags flags = caseSensitive ? QTextDocument::FindCaseSensitively
+                                                         : QTextDocument::FindFlags();
+    size_t documentCount = 0;
+    const double documentTime = bestTime([&] {
+        documentCount = 0;
+        QTextCursor cursor = document->find(pattern, 0, flags);
+        while (!cursor.isNull()) {
+            ++documentCount;
+            cursor = document->find(pattern, cursor, flags);
+        }
+    });
+
+    const Qt::CaseSensitivity cs = caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    size_t stringCount = 0;
+    const double stringTime = bestTime([&] {
+        stringCount = 0;
+        int pos = text.indexOf(pattern, 0, cs);
+        while (pos >= 0) {
+            ++stringCount;
+            pos = text.indexOf(pattern, pos + pattern.size(), cs);
+        }
+    });
+
+    std::vector<SyntaxTextEdit::SearchMatch> matches;
+    const double kernelTime = bestTime([&] {
+        matches.clear();
+        SyntaxTextEdit::findMatches(text, 0, params, QRegularExpression(), &matches);
+    });
+
+    const double mbytes = static_cast<double>(text.size()) * 2 / (1024.0 * 1024.0);
+    const bool match = (documentCount == stringCount && stringCount == matches.size());
+    std::printf("%-22s %-5s %9zu %10.1f %10.1f %10.1f %8.1fx  %s\n",
+                pattern.toUtf8().constData(), caseSensitive ? "yes" : "no",
+                matches.size(), mbytes / documentTime, mbytes / stringTime,
+                mbytes / kernelTime, documentTime / kernelTime,
+                match ? "ok" : "MISMATCH");
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    size_t size = 32;
+    if (argc > 1)
+        size = std::strtoul(argv[1], nullptr, 10);
+    size *= 1024 * 1024;
+
+    // The size is in bytes of UTF-16 text, to match the MB/s figures
+    std::mt19937 rng(12345);
+    const QString log = makeLog(size / 2, rng);
+    QTextDocument document;
+    document.setPlainText(log);
+    const QString text = document.toRawText();
+
+    std::printf("Vector instructions: %s\n\n", LiteralSearch::simdLevel());
+    std::printf("%-22s %-5s %9s %10s %10s %10s %9s\n", "Pattern", "Case", "Matches",
+                "find MB/s", "indexOf", "Kernel", "Speedup");
+    benchSearch(&document, text, QStringLiteral("OutOfMemoryError"), true);
+    benchSearch(&document, text, QStringLiteral("outofmemoryerror"), false);
+    benchSearch(&document, text, QStringLiteral("completed"), true);
+    benchSearch(&document, text, QStringLiteral("SLOW QUERY"), false);
+    benchSearch(&document, text, QStringLiteral("Request 4242 "), true);
+    benchSearch(&document, text, QStringLiteral("k"), false);
+
+    return 0;
+}
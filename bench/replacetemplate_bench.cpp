@@ -0,0 +1,171 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Times the two stages of a regex Replace All separately: parsing the
+// replacement string into a ReplaceTemplate (once per Replace All), and
+// applying it to each match.  For comparison, it also times parsing the
+// replacement again for every match, which is what SearchDialog used to
+// do, and checks that both produce the same text.
+//
+// Usage: replacetemplate_bench [number of lines]
+
+#include "replacetemplate.h"
+
+#include <QCoreApplication>
+#include <QRegularExpression>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+#define BENCH_ITERATIONS    3
+#define PARSE_ITERATIONS    100000
+
+// Assignments with a name and a number to capture on every line
+static QString makeText(size_t lines, std::mt19937 &rng)
+{
+    static const char *const names[] = {
+        "width", "height", "max_connections", "timeout", "retry_count", "x",
+    };
+    std::uniform_int_distribution<size_t> pick(0, sizeof(names) / sizeof(names[0]) - 1);
+    std::uniform_int_distribution<int> number(0, 99999);
+    QString out;
+    char line[128];
+    for (size_t i = 0; i < lines; ++i) {
+        std::snprintf(line, sizeof(line), "    config.%s = %d;\n", names[pick(rng)], number(rng));
+        out += QLatin1String(line);
+    }
+    return out;
+}
+
+// The replacement string parsing SearchDialog::regexReplace() did for
+// each match
+static QString parseEveryMatch(const QString &text, const QRegularExpressionMatch &regexMatch)
+{
+    QString result;
+    result.reserve(text.size());
+    int start = 0;
+    for ( ;; ) {
+        int pos = text.indexOf(QLatin1Char('\\'), start);
+        if (pos < 0 || pos + 1 >= text.size())
+            break;
+
+        result.append(text.constData() + start, pos - start);
+        QChar next = text.at(pos + 1);
+        if (next.unicode() >= '0' && next.unicode() <= '9') {
+            QByteArray number = text.mid(pos + 1, 2).toLatin1();
+            char *end;
+            ulong ref = std::strtoul(number.constData(), &end, 10);
+            result.append(regexMatch.captured(static_cast<int>(ref)));
+            start = pos + 1 + static_cast<int>(end - number.constData());
+        } else {
+            result.append(QLatin1Char('\\'));
+            result.append(next);
+            start = pos + 2;
+        }
+    }
+
+    result.append(text.constData() + start, text.size() - start);
+    return result;
+}
+
+static double bestTime(const std::function<void ()> &func)
+{
+    double best = 1e9;
+    for (int i = 0; i < BENCH_ITERATIONS; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+static void benchReplace(const std::vector<QRegularExpressionMatch> &matches,
+                         const QString &replacement)
+{
+    const double parseTime = bestTime([&] {
+        for (int i = 0; i < PARSE_ITERATIONS; ++i) {
+            const ReplaceTemplate replaceTemplate(replacement);
+            (void)replaceTemplate;
+        }
+    });
+
+    // Only the replacements are built here; copying the text in between
+    // them is the same either way.
+    const ReplaceTemplate replaceTemplate(replacement);
+    QString compiled;
+    const double applyTime = bestTime([&] {
+        int size = 0;
+        for (const auto &match : matches)
+            size += replaceTemplate.replacementLength(match);
+        compiled.clear();
+        compiled.reserve(size);
+        for (const auto &match : matches)
+            replaceTemplate.apply(match, &compiled);
+    });
+
+    QString reparsed;
+    const double reparseTime = bestTime([&] {
+        reparsed.clear();
+        for (const auto &match : matches)
+            reparsed.append(parseEveryMatch(replacement, match));
+    });
+
+    const double count = static_cast<double>(matches.size());
+    std::printf("%-18s %10.1f %12.1f %12.1f %8.1fx  %s\n",
+                replacement.toUtf8().constData(),
+                parseTime * 1e9 / PARSE_ITERATIONS,
+                applyTime * 1e9 / count, reparseTime * 1e9 / count,
+                reparseTime / applyTime,
+                compiled == reparsed ? "ok" : "MISMATCH");
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    size_t lines = 500000;
+    if (argc > 1)
+        lines = std::strtoul(argv[1], nullptr, 10);
+
+    std::mt19937 rng(12345);
+    const QString text = makeText(lines, rng);
+
+    // Collecting the matches isn't part of either stage
+    const QRegularExpression re(QStringLiteral("config\\.(\\w+) = (\\d+)"));
+    std::vector<QRegularExpressionMatch> matches;
+    matches.reserve(lines);
+    auto iter = re.globalMatch(text);
+    while (iter.hasNext())
+        matches.push_back(iter.next());
+
+    std::printf("%zu matches\n\n", matches.size());
+    std::printf("%-18s %10s %12s %12s %9s\n", "Replacement", "Parse ns",
+                "Apply ns/m", "Reparse ns/m", "Speedup");
+    benchReplace(matches, QStringLiteral("\\2"));
+    benchReplace(matches, QStringLiteral("set(\"\\1\", \\2)"));
+    benchReplace(matches, QStringLiteral("\\0 // was \\2"));
+    benchReplace(matches, QStringLiteral("settings->\\1"));
+    benchReplace(matches, QStringLiteral("C:\\temp\\\\1"));
+    benchReplace(matches, QStringLiteral("removed"));
+
+    return 0;
+}
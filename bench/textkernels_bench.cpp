@@ -0,0 +1,322 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compares the TextKernels fast paths against the equivalent ICU conversions,
+// and checks that both produce the same results.
+//
+// Usage: textkernels_bench [size in MiB]
+
+#include "textkernels.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef QTEXTPAD_USE_WIN10_ICU
+#include <icu.h>
+#else
+#include <unicode/ucnv.h>
+#endif
+
+#define BENCH_ITERATIONS    5
+
+typedef std::vector<char16_t> Utf16Buffer;
+
+static void appendUtf8(std::string &out, uint32_t ch)
+{
+    if (ch < 0x80) {
+        out += static_cast<char>(ch);
+    } else if (ch < 0x800) {
+        out += static_cast<char>(0xC0 | (ch >> 6));
+        out += static_cast<char>(0x80 | (ch & 0x3F));
+    } else if (ch < 0x10000) {
+        out += static_cast<char>(0xE0 | (ch >> 12));
+        out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (ch & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (ch >> 18));
+        out += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (ch & 0x3F));
+    }
+}
+
+// Mostly source code, with the occasional accented character in a comment
+static std::string makeAsciiHeavy(size_t size, std::mt19937 &rng)
+{
+    static const char *const lines[] = {
+        "    for (int i = 0; i < count; ++i) {\n",
+        "        result += process(items.at(i), options);\n",
+        "    }\n",
+        "// Returns the number of characters that were converted\n",
+        "static inline bool isValid(const QByteArray &data)\n",
+        "\n",
+        "    return m_editor->document()->isModified();\n",
+    };
+    std::uniform_int_distribution<size_t> pick(0, sizeof(lines) / sizeof(lines[0]) - 1);
+    std::uniform_int_distribution<int> accent(0, 50);
+    std::string out;
+    out.reserve(size + 64);
+    while (out.size() < size) {
+        out += lines[pick(rng)];
+        if (accent(rng) == 0)
+            out += "// r\xC3\xA9sum\xC3\xA9 na\xC3\xAFve caf\xC3\xA9\n";
+    }
+    return out;
+}
+
+// Mostly CJK ideographs, with ASCII punctuation and line breaks
+static std::string makeCjkHeavy(size_t size, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<uint32_t> hanzi(0x4E00, 0x9FFF);
+    std::uniform_int_distribution<int> other(0, 30);
+    std::string out;
+    out.reserve(size + 64);
+    int column = 0;
+    while (out.size() < size) {
+        const int kind = other(rng);
+        if (kind == 0)
+            appendUtf8(out, 0x3002);
+        else if (kind == 1)
+            out += ", ";
+        else if (kind == 2)
+            appendUtf8(out, 0x20000 + hanzi(rng) - 0x4E00);
+        else
+            appendUtf8(out, hanzi(rng));
+        if (++column == 40) {
+            out += '\n';
+            column = 0;
+        }
+    }
+    return out;
+}
+
+// Mixed text with frequent invalid bytes and broken sequences
+static std::string makeInvalid(size_t size, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<int> kind(0, 15);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::string out;
+    out.reserve(size + 64);
+    while (out.size() < size) {
+        switch (kind(rng)) {
+        case 0:
+            out += static_cast<char>(byte(rng));
+            break;
+        case 1:
+            out += "\xE4\xB8";      // Truncated 3-byte sequence
+            break;
+        case 2:
+            out += "\xED\xA0\x80";  // Encoded surrogate
+            break;
+        case 3:
+            out += "\xC0\xAF";      // Overlong
+            break;
+        case 4:
+            appendUtf8(out, 0x4E2D);
+            break;
+        default:
+            out += "text ";
+            break;
+        }
+    }
+    return out;
+}
+
+static std::string makeLatin1(size_t size, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<int> byte(0x20, 0xFF);
+    std::uniform_int_distribution<int> ascii(0x20, 0x7E);
+    std::uniform_int_distribution<int> kind(0, 9);
+    std::string out(size, '\0');
+    for (auto &ch : out)
+        ch = static_cast<char>(kind(rng) == 0 ? byte(rng) : ascii(rng));
+    return out;
+}
+
+static double bestTime(const std::function<void ()> &func)
+{
+    double best = 1e9;
+    for (int i = 0; i < BENCH_ITERATIONS; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+static void report(const char *input, const char *operation, size_t bytes,
+                   double icuTime, double kernelTime, bool match)
+{
+    const double mbytes = static_cast<double>(bytes) / (1024.0 * 1024.0);
+    std::printf("%-12s %-14s %10.1f %10.1f %8.1fx  %s\n", input, operation,
+                mbytes / icuTime, mbytes / kernelTime, icuTime / kernelTime,
+                match ? "ok" : "MISMATCH");
+}
+
+static UConverter *openConverter(const char *name, bool stopOnError)
+{
+    UErrorCode err = U_ZERO_ERROR;
+    UConverter *converter = ucnv_open(name, &err);
+    if (U_FAILURE(err)) {
+        std::fprintf(stderr, "Could not open %s: %s\n", name, u_errorName(err));
+        std::exit(1);
+    }
+    if (stopOnError) {
+        ucnv_setToUCallBack(converter, UCNV_TO_U_CALLBACK_STOP, nullptr,
+                            nullptr, nullptr, &err);
+    }
+    return converter;
+}
+
+static Utf16Buffer icuDecode(UConverter *converter, const std::string &input, bool *valid)
+{
+    Utf16Buffer output(input.size() + 1);
+    ucnv_reset(converter);
+    auto outptr = reinterpret_cast<UChar *>(output.data());
+    const char *inptr = input.data();
+    UErrorCode err = U_ZERO_ERROR;
+    ucnv_toUnicode(converter, &outptr, outptr + output.size(), &inptr,
+                   input.data() + input.size(), nullptr, true, &err);
+    if (valid)
+        *valid = U_SUCCESS(err);
+    output.resize(outptr - reinterpret_cast<UChar *>(output.data()));
+    return output;
+}
+
+static std::string icuEncode(UConverter *converter, const Utf16Buffer &input)
+{
+    std::string output(input.size() * 3 + 4, '\0');
+    ucnv_reset(converter);
+    char *outptr = &output[0];
+    auto inptr = reinterpret_cast<const UChar *>(input.data());
+    UErrorCode err = U_ZERO_ERROR;
+    ucnv_fromUnicode(converter, &outptr, outptr + output.size(), &inptr,
+                     inptr + input.size(), nullptr, true, &err);
+    output.resize(outptr - output.data());
+    return output;
+}
+
+static void benchUtf8(const char *label, const std::string &input)
+{
+    UConverter *converter = openConverter("UTF-8", false);
+    UConverter *validator = openConverter("UTF-8", true);
+
+    Utf16Buffer icuText, kernelText;
+    const double icuDecodeTime = bestTime([&] {
+        icuText = icuDecode(converter, input, nullptr);
+    });
+    const double kernelDecodeTime = bestTime([&] {
+        kernelText.resize(input.size());
+        size_t length;
+        TextKernels::utf8ToUtf16(input.data(), input.size(), kernelText.data(),
+                                 &length, true);
+        kernelText.resize(length);
+    });
+    report(label, "decode", input.size(), icuDecodeTime, kernelDecodeTime,
+           icuText == kernelText);
+
+    bool icuValid = false, kernelValid = false;
+    const double icuValidateTime = bestTime([&] {
+        (void)icuDecode(validator, input, &icuValid);
+    });
+    const double kernelValidateTime = bestTime([&] {
+        kernelValid = TextKernels::utf8ValidLength(input.data(), input.size(), true)
+                      == input.size();
+    });
+    report(label, "validate", input.size(), icuValidateTime, kernelValidateTime,
+           icuValid == kernelValid);
+
+    std::string icuBytes, kernelBytes;
+    const double icuEncodeTime = bestTime([&] {
+        icuBytes = icuEncode(converter, icuText);
+    });
+    const double kernelEncodeTime = bestTime([&] {
+        kernelBytes.resize(icuText.size() * 3);
+        char16_t pending = 0;
+        kernelBytes.resize(TextKernels::utf16ToUtf8(icuText.data(), icuText.size(),
+                                                    &kernelBytes[0], &pending, true));
+    });
+    report(label, "encode", icuBytes.size(), icuEncodeTime, kernelEncodeTime,
+           icuBytes == kernelBytes);
+
+    ucnv_close(validator);
+    ucnv_close(converter);
+}
+
+static void benchLatin1(const char *label, const char *codecName, unsigned maxChar,
+                        const std::string &input)
+{
+    UConverter *converter = openConverter(codecName, false);
+
+    Utf16Buffer icuText, kernelText;
+    const double icuDecodeTime = bestTime([&] {
+        icuText = icuDecode(converter, input, nullptr);
+    });
+    const double kernelDecodeTime = bestTime([&] {
+        kernelText.resize(input.size());
+        TextKernels::latin1ToUtf16(input.data(), input.size(), kernelText.data(), maxChar);
+    });
+    report(label, "decode", input.size(), icuDecodeTime, kernelDecodeTime,
+           icuText == kernelText);
+
+    std::string icuBytes, kernelBytes;
+    const double icuEncodeTime = bestTime([&] {
+        icuBytes = icuEncode(converter, icuText);
+    });
+    const double kernelEncodeTime = bestTime([&] {
+        kernelBytes.resize(icuText.size());
+        char16_t pending = 0;
+        kernelBytes.resize(TextKernels::utf16ToLatin1(icuText.data(), icuText.size(),
+                                                      &kernelBytes[0], &pending, true,
+                                                      maxChar));
+    });
+    report(label, "encode", icuBytes.size(), icuEncodeTime, kernelEncodeTime,
+           icuBytes == kernelBytes);
+
+    ucnv_close(converter);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = 32;
+    if (argc > 1)
+        size = std::strtoul(argv[1], nullptr, 10);
+    size *= 1024 * 1024;
+
+    std::mt19937 rng(12345);
+    const std::string asciiHeavy = makeAsciiHeavy(size, rng);
+    const std::string cjkHeavy = makeCjkHeavy(size, rng);
+    const std::string invalid = makeInvalid(size, rng);
+    const std::string latin1 = makeLatin1(size, rng);
+
+    std::printf("Vector instructions: %s\n\n", TextKernels::simdLevel());
+    std::printf("%-12s %-14s %10s %10s %9s\n", "Input", "Operation",
+                "ICU MB/s", "Fast MB/s", "Speedup");
+    benchUtf8("ASCII-heavy", asciiHeavy);
+    benchUtf8("CJK-heavy", cjkHeavy);
+    benchUtf8("Invalid", invalid);
+    benchLatin1("ISO-8859-1", "ISO-8859-1", 0xFF, latin1);
+    benchLatin1("US-ASCII", "US-ASCII", 0x7F, latin1);
+
+    return 0;
+}
@@ -0,0 +1,197 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "literalsearch.h"
+
+#include <algorithm>
+
+#include "simdsupport.h"
+
+using LiteralSearch::Pattern;
+
+#ifdef SIMDSUPPORT_AVX2
+static const bool s_hasAvx2 = SimdSupport::detectAvx2();
+#endif
+
+void LiteralSearch::initFoldTable(FoldTable *table)
+{
+    table->reverse.clear();
+    for (uint32_t unit = 0; unit < 0x10000; ++unit) {
+        if (table->fold[unit] != unit)
+            table->reverse.push_back((static_cast<uint32_t>(table->fold[unit]) << 16) | unit);
+    }
+    std::sort(table->reverse.begin(), table->reverse.end());
+}
+
+// Collects the code units which fold to ch.  Returns 0 if there are more
+// than MaxVariants of them.
+static unsigned foldVariants(const LiteralSearch::FoldTable &table, char16_t ch,
+                             char16_t *variants)
+{
+    unsigned count = 0;
+    if (table.fold[ch] == ch)
+        variants[count++] = ch;
+
+    const uint32_t key = static_cast<uint32_t>(ch) << 16;
+    auto iter = std::lower_bound(table.reverse.begin(), table.reverse.end(), key);
+    for ( ; iter != table.reverse.end() && (*iter >> 16) == ch; ++iter) {
+        if (count == LiteralSearch::MaxVariants)
+            return 0;
+        variants[count++] = static_cast<char16_t>(*iter & 0xFFFF);
+    }
+    return count;
+}
+
+void LiteralSearch::compile(Pattern *pattern, const char16_t *text, size_t size,
+                            const FoldTable &table)
+{
+    pattern->table = &table;
+    pattern->text.resize(size);
+    for (size_t i = 0; i < size; ++i)
+        pattern->text[i] = table.fold[text[i]];
+    pattern->firstCount = foldVariants(table, pattern->text.front(), pattern->first);
+    pattern->lastCount = foldVariants(table, pattern->text.back(), pattern->last);
+}
+
+static inline bool matchesAt(const Pattern &pattern, const char16_t *text)
+{
+    const char16_t *fold = pattern.table->fold;
+    const size_t size = pattern.text.size();
+    for (size_t i = 0; i < size; ++i) {
+        if (fold[text[i]] != pattern.text[i])
+            return false;
+    }
+    return true;
+}
+
+#ifdef SIMDSUPPORT_AVX2
+TARGET_AVX2
+static inline __m256i matchAnyAvx2(__m256i chunk, const char16_t *variants, unsigned count)
+{
+    // With no variants to compare, every position is a candidate
+    if (count == 0)
+        return _mm256_set1_epi8(-1);
+    __m256i match = _mm256_cmpeq_epi16(chunk, _mm256_set1_epi16(static_cast<short>(variants[0])));
+    for (unsigned i = 1; i < count; ++i) {
+        match = _mm256_or_si256(match, _mm256_cmpeq_epi16(
+                        chunk, _mm256_set1_epi16(static_cast<short>(variants[i]))));
+    }
+    return match;
+}
+
+// Checks 16 positions at a time, and returns the first match or NotFound.
+// *pos is left at the first position that wasn't checked.
+TARGET_AVX2
+static size_t findAvx2(const Pattern &pattern, const char16_t *text, size_t size, size_t *pos)
+{
+    const size_t lastOffset = pattern.text.size() - 1;
+    for ( ; *pos + lastOffset + 16 <= size; *pos += 16) {
+        const __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + *pos));
+        const __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + *pos + lastOffset));
+        const __m256i match = _mm256_and_si256(
+                    matchAnyAvx2(head, pattern.first, pattern.firstCount),
+                    matchAnyAvx2(tail, pattern.last, pattern.lastCount));
+
+        // Two mask bits for each code unit
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(match));
+        while (mask) {
+            const unsigned bit = SimdSupport::countTrailingZeros(mask);
+            if (matchesAt(pattern, text + *pos + bit / 2))
+                return *pos + bit / 2;
+            mask &= ~(3u << bit);
+        }
+    }
+    return LiteralSearch::NotFound;
+}
+#endif
+
+#ifdef SIMDSUPPORT_SSE2
+static inline __m128i matchAnySse2(__m128i chunk, const char16_t *variants, unsigned count)
+{
+    if (count == 0)
+        return _mm_set1_epi8(-1);
+    __m128i match = _mm_cmpeq_epi16(chunk, _mm_set1_epi16(static_cast<short>(variants[0])));
+    for (unsigned i = 1; i < count; ++i) {
+        match = _mm_or_si128(match, _mm_cmpeq_epi16(
+                        chunk, _mm_set1_epi16(static_cast<short>(variants[i]))));
+    }
+    return match;
+}
+
+static size_t findSse2(const Pattern &pattern, const char16_t *text, size_t size, size_t *pos)
+{
+    const size_t lastOffset = pattern.text.size() - 1;
+    for ( ; *pos + lastOffset + 8 <= size; *pos += 8) {
+        const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + *pos));
+        const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + *pos + lastOffset));
+        const __m128i match = _mm_and_si128(matchAnySse2(head, pattern.first, pattern.firstCount),
+                                            matchAnySse2(tail, pattern.last, pattern.lastCount));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(match));
+        while (mask) {
+            const unsigned bit = SimdSupport::countTrailingZeros(mask);
+            if (matchesAt(pattern, text + *pos + bit / 2))
+                return *pos + bit / 2;
+            mask &= ~(3u << bit);
+        }
+    }
+    return LiteralSearch::NotFound;
+}
+#endif
+
+size_t LiteralSearch::find(const Pattern &pattern, const char16_t *text, size_t size,
+                           size_t from)
+{
+    const size_t length = pattern.text.size();
+    if (length > size || from > size - length)
+        return NotFound;
+
+    size_t pos = from;
+#ifdef SIMDSUPPORT_SSE2
+    // If neither end of the pattern can be compared, the filter wouldn't
+    // rule anything out.
+    if (pattern.firstCount != 0 || pattern.lastCount != 0) {
+        size_t found = NotFound;
+#ifdef SIMDSUPPORT_AVX2
+        if (s_hasAvx2)
+            found = findAvx2(pattern, text, size, &pos);
+        if (found != NotFound)
+            return found;
+#endif
+        found = findSse2(pattern, text, size, &pos);
+        if (found != NotFound)
+            return found;
+    }
+#endif
+    for ( ; pos + length <= size; ++pos) {
+        if (matchesAt(pattern, text + pos))
+            return pos;
+    }
+    return NotFound;
+}
+
+const char *LiteralSearch::simdLevel()
+{
+#if defined(SIMDSUPPORT_AVX2)
+    if (s_hasAvx2)
+        return "AVX2";
+#endif
+#if defined(SIMDSUPPORT_SSE2)
+    return "SSE2";
+#else
+    return "Scalar";
+#endif
+}
@@ -0,0 +1,82 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTEXTPAD_LITERALSEARCH_H
+#define QTEXTPAD_LITERALSEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Finds plain (non-regex) search text in UTF-16 text.  Candidate positions
+// are found by comparing the first and last characters of the pattern
+// against a whole vector of text at a time (SSE2, or AVX2 where the CPU
+// supports it), and only those are compared in full.
+//
+// Characters are compared through a FoldTable, which is how case folding
+// is done for case-insensitive searches.  This has no Qt dependencies;
+// the caller fills in the table.
+namespace LiteralSearch
+{
+    const size_t NotFound = static_cast<size_t>(-1);
+
+    struct FoldTable
+    {
+        // The code unit each UTF-16 code unit is compared as
+        char16_t fold[65536];
+
+        // Every unit that doesn't fold to itself, as (fold << 16) | unit,
+        // sorted.  Filled in by initFoldTable().
+        std::vector<uint32_t> reverse;
+    };
+
+    // Builds the reverse mapping once the caller has filled in fold.
+    void initFoldTable(FoldTable *table);
+
+    // Vector comparisons are only used for characters which have at most
+    // this many code units that fold to them (e.g. "k", "K" and U+212A
+    // KELVIN SIGN).
+    const unsigned MaxVariants = 4;
+
+    struct Pattern
+    {
+        std::u16string text;            // Already folded
+        const FoldTable *table;
+
+        // Units that fold to the first and last character of the pattern.
+        // A count of 0 means there were too many to compare.
+        char16_t first[MaxVariants];
+        unsigned firstCount;
+        char16_t last[MaxVariants];
+        unsigned lastCount;
+    };
+
+    // The table must outlive the pattern.  size must not be 0.
+    void compile(Pattern *pattern, const char16_t *text, size_t size,
+                 const FoldTable &table);
+
+    // Returns the position of the first match at or after from, or
+    // NotFound.
+    size_t find(const Pattern &pattern, const char16_t *text, size_t size,
+                size_t from = 0);
+
+    // Name of the instruction set used for the vector paths, for logging.
+    const char *simdLevel();
+}
+
+#endif // QTEXTPAD_LITERALSEARCH_H
@@ -0,0 +1,66 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "livesearchworker.h"
+
+LiveSearchWorker::LiveSearchWorker(QString text, const SyntaxTextEdit::SearchParams &params,
+                                   QRegularExpression regex, bool multiLine,
+                                   QObject *parent)
+    : QThread(parent), m_text(std::move(text)), m_params(params),
+      m_regex(std::move(regex)), m_multiLine(multiLine), m_tooComplex()
+{
+}
+
+void LiveSearchWorker::run()
+{
+    if (m_multiLine || !m_params.regex) {
+        // Matches can cross blocks, so this has to be done in one go.  Plain
+        // text is also faster to search all at once.
+        const bool completed = SyntaxTextEdit::findMatches(m_text, 0, m_params, m_regex,
+                                                           &m_matches, 0, nullptr,
+                                                           [this] { return isInterruptionRequested(); });
+        if (!completed)
+            m_tooComplex = true;
+        if (!completed || isInterruptionRequested())
+            m_matches.clear();
+        return;
+    }
+
+    // Blocks are separated by '\n' in the snapshot.  Other line separators
+    // (such as U+2028) are part of the block.  A slow regex can take a while
+    // on each line, so we check for cancellation after every one.
+    int start = 0;
+    for ( ;; ) {
+        int end = m_text.indexOf(QLatin1Char('\n'), start);
+        if (end < 0)
+            end = m_text.size();
+        if (!SyntaxTextEdit::findMatches(m_text.mid(start, end - start), start,
+                                         m_params, m_regex, &m_matches)) {
+            m_tooComplex = true;
+            m_matches.clear();
+            return;
+        }
+        if (end >= m_text.size())
+            break;
+        start = end + 1;
+
+        if (isInterruptionRequested()) {
+            m_matches.clear();
+            return;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTEXTPAD_LIVESEARCHWORKER_H
+#define QTEXTPAD_LIVESEARCHWORKER_H
+
+#include <QThread>
+
+#include "syntaxtextedit.h"
+
+// Finds every live search match in a snapshot of the document, so a large
+// document can be searched without blocking the editor.  The snapshot is
+// SyntaxTextEdit::searchSnapshot(), where the positions are the same as the
+// document's own positions.
+class LiveSearchWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    LiveSearchWorker(QString text, const SyntaxTextEdit::SearchParams &params,
+                     QRegularExpression regex, bool multiLine,
+                     QObject *parent = nullptr);
+
+    void cancel() { requestInterruption(); }
+
+    // QTextDocument::characterCount() at the time of the snapshot
+    int documentLength() const { return m_text.size() + 1; }
+
+    std::vector<SyntaxTextEdit::SearchMatch> takeMatches() { return std::move(m_matches); }
+
+    // The regex exceeded its match limit somewhere in the document
+    bool tooComplex() const { return m_tooComplex; }
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    QString m_text;
+    SyntaxTextEdit::SearchParams m_params;
+    QRegularExpression m_regex;
+    std::vector<SyntaxTextEdit::SearchMatch> m_matches;
+    bool m_multiLine;
+    bool m_tooComplex;
+};
+
+#endif // QTEXTPAD_LIVESEARCHWORKER_H
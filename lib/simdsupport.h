@@ -0,0 +1,81 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QTEXTPAD_SIMDSUPPORT_H
+#define QTEXTPAD_SIMDSUPPORT_H
+
+// Shared helpers for the SSE2 and AVX2 kernels.  SSE2 is part of the x86-64
+// baseline, so SIMDSUPPORT_SSE2 is defined whenever the compiler targets it.
+// AVX2 kernels are compiled with TARGET_AVX2, and must only be called if
+// SimdSupport::detectAvx2() says the CPU (and OS) support them.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define SIMDSUPPORT_SSE2
+#   include <emmintrin.h>
+#   if defined(__GNUC__) || defined(__clang__)
+#       define SIMDSUPPORT_AVX2
+#       define TARGET_AVX2 __attribute__((target("avx2")))
+#       include <immintrin.h>
+#   elif defined(_MSC_VER)
+#       define SIMDSUPPORT_AVX2
+#       define TARGET_AVX2
+#       include <intrin.h>
+#       include <immintrin.h>
+#   endif
+#endif
+
+namespace SimdSupport
+{
+#ifdef SIMDSUPPORT_SSE2
+    inline unsigned countTrailingZeros(unsigned value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned>(__builtin_ctz(value));
+#else
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return static_cast<unsigned>(index);
+#endif
+    }
+#endif
+
+#ifdef SIMDSUPPORT_AVX2
+    inline bool detectAvx2()
+    {
+#if defined(__GNUC__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#else
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        // AVX2 also needs the OS to save the YMM registers
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#endif
+    }
+#endif
+}
+
+#endif // QTEXTPAD_SIMDSUPPORT_H
@@ -18,11 +18,15 @@
 
 #include <QScrollBar>
 #include <QTextBlock>
+#include <QTextLayout>
 #include <QPainter>
 #include <QPrinter>
 #include <QRegularExpression>
 #include <QStack>
 #include <QStringView>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMutex>
 #include <QtMath>
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
@@ -37,6 +41,8 @@
 
 #include <cmath>
 
+#include "literalsearch.h"
+#include "livesearchworker.h"
 #include "syntaxhighlighter.h"
 
 enum SyntaxTextEdit_Config
@@ -51,6 +57,41 @@ enum SyntaxTextEdit_Config
     Config_ShowFolding = (1U<<7),
 };
 
+// Progressive population limits.  The first screen is set synchronously,
+// and each later batch is kept short enough to not stall the event loop.
+#define POPULATE_INITIAL_LINES  5000
+#define POPULATE_BATCH_LINES    2000
+#define POPULATE_TIME_SLICE     15      // ms
+
+// Number of compiled search patterns to keep around.  Find Next, Replace All
+// and the live search all reuse the same handful of patterns.
+#define REGEX_CACHE_SIZE        16
+
+// Search patterns are limited to this many backtracking steps per match
+// attempt, which takes a few milliseconds at most.  Patterns with
+// catastrophic backtracking (such as "(a+)+b") give up instead of hanging
+// the editor.
+#define REGEX_MATCH_LIMIT       1000000
+
+// Documents longer than this (in characters) are searched in the background
+// for live search, and only the visible blocks are searched right away.
+// Edits made during the search that span more than this restart it.
+#define LIVE_SEARCH_SYNC_LENGTH (1024 * 1024)
+
+// Smaller documents are also handed off to the background search if they
+// take longer than this (e.g. because of a slow regex).
+#define LIVE_SEARCH_SYNC_TIME   100     // ms
+
+// A multi-line search has to start over after any edit.  For documents
+// longer than LIVE_SEARCH_SYNC_LENGTH, that waits until there have been no
+// edits for this long.
+#define LIVE_SEARCH_RESTART_DELAY 300   // ms
+
+// How often findMatches() checks whether it's been interrupted: after this
+// many matches, or after moving this far through the text.
+#define SEARCH_INTERRUPT_MATCHES  256
+#define SEARCH_INTERRUPT_DISTANCE (1024 * 1024)
+
 KSyntaxHighlighting::Repository *SyntaxTextEdit::syntaxRepo()
 {
     static KSyntaxHighlighting::Repository s_syntaxRepo;
@@ -66,9 +107,20 @@ const KSyntaxHighlighting::Definition &SyntaxTextEdit::nullSyntax()
 SyntaxTextEdit::SyntaxTextEdit(QWidget *parent)
     : QPlainTextEdit(parent), m_tabCharSize(4), m_indentWidth(4),
       m_longLineMarker(80), m_config(), m_indentationMode(),
-      m_originalFontSize()
+      m_originalFontSize(), m_liveSearchMultiLine(), m_searchShiftIndex(),
+      m_searchShift(), m_liveSearchLength(), m_searchWorker(), m_searchDirtyStart(-1),
+      m_searchDirtyEnd(-1), m_populateOffset(), m_populateReadOnly()
 {
     m_lineMargin = new LineMargin(this);
+    m_populateTimer = new QTimer(this);
+    m_populateTimer->setInterval(0);
+    connect(m_populateTimer, &QTimer::timeout,
+            this, &SyntaxTextEdit::populateNextBatch);
+    m_liveSearchRestartTimer = new QTimer(this);
+    m_liveSearchRestartTimer->setSingleShot(true);
+    m_liveSearchRestartTimer->setInterval(LIVE_SEARCH_RESTART_DELAY);
+    connect(m_liveSearchRestartTimer, &QTimer::timeout,
+            this, &SyntaxTextEdit::updateLiveSearch);
     m_highlighter = new SyntaxHighlighter(document());
     m_highlighter->setTabWidth(m_tabCharSize);
 
@@ -78,8 +130,9 @@ SyntaxTextEdit::SyntaxTextEdit(QWidget *parent)
             this, &SyntaxTextEdit::updateLineNumbers);
     connect(this, &QPlainTextEdit::cursorPositionChanged,
             this, &SyntaxTextEdit::updateCursor);
-    connect(this, &QPlainTextEdit::textChanged,
-            this, &SyntaxTextEdit::updateLiveSearch);
+    m_liveSearchLength = document()->characterCount();
+    connect(document(), &QTextDocument::contentsChange,
+            this, &SyntaxTextEdit::liveSearchContentsChange);
 
     // Initialize default editor configuration
     QFont fixedFont = QFontDatabase::systemFont(QFontDatabase::FixedFont);
@@ -93,6 +146,16 @@ SyntaxTextEdit::SyntaxTextEdit(QWidget *parent)
     document()->setDefaultTextOption(opt);
 }
 
+SyntaxTextEdit::~SyntaxTextEdit()
+{
+    // Cancelled workers may still be finishing up
+    const auto workers = findChildren<LiveSearchWorker *>();
+    for (LiveSearchWorker *worker : workers) {
+        worker->cancel();
+        worker->wait();
+    }
+}
+
 void SyntaxTextEdit::deleteSelection()
 {
     QTextCursor cursor = textCursor();
@@ -496,6 +559,133 @@ bool SyntaxTextEdit::wordWrap() const
     return wordWrapMode() != QTextOption::NoWrap;
 }
 
+static inline const char16_t *utf16Data(const QString &text)
+{
+    return reinterpret_cast<const char16_t *>(text.constData());
+}
+
+// Case folding for LiteralSearch.  This finds the same matches as
+// QString::indexOf() does on text where QChar::Nbsp has been replaced by a
+// space, which is what QTextDocument::find() searches.
+static const LiteralSearch::FoldTable &literalFoldTable(bool caseSensitive)
+{
+    struct FoldTables
+    {
+        LiteralSearch::FoldTable exact;
+        LiteralSearch::FoldTable folded;
+
+        FoldTables()
+        {
+            for (uint ch = 0; ch < 0x10000; ++ch) {
+                exact.fold[ch] = static_cast<char16_t>(ch);
+                folded.fold[ch] = static_cast<char16_t>(QChar::toCaseFolded(ch));
+            }
+            exact.fold[QChar::Nbsp] = ' ';
+            folded.fold[QChar::Nbsp] = ' ';
+            LiteralSearch::initFoldTable(&exact);
+            LiteralSearch::initFoldTable(&folded);
+        }
+    };
+    static const FoldTables s_tables;
+    return caseSensitive ? s_tables.exact : s_tables.folded;
+}
+
+// QString folds the case of surrogate pairs as a whole, so those can't be
+// compared one code unit at a time.  The fold tables also turn QChar::Nbsp
+// into a space, which is only right for the text being searched; a search
+// for Nbsp itself never matches in QTextDocument::find().  Returns false if
+// the search text needs to be left to QString.
+static bool compileLiteral(const SyntaxTextEdit::SearchParams &params,
+                           LiteralSearch::Pattern *pattern)
+{
+    const QString &text = params.searchText;
+    if (text.isEmpty())
+        return false;
+    for (const QChar ch : text) {
+        if (ch == QChar::Nbsp || (!params.caseSensitive && ch.isSurrogate()))
+            return false;
+    }
+    LiteralSearch::compile(pattern, utf16Data(text), text.size(),
+                           literalFoldTable(params.caseSensitive));
+    return true;
+}
+
+static inline bool isWholeWord(const QString &text, int start, int end)
+{
+    return (start == 0 || !text.at(start - 1).isLetterOrNumber())
+            && (end == text.size() || !text.at(end).isLetterOrNumber());
+}
+
+template <typename Findable>
+static QTextCursor documentFind(QTextDocument *document, const Findable &search,
+                                const QTextCursor &start, QTextDocument::FindFlags flags)
+{
+    return document->find(search, start, flags);
+}
+
+// The same search as QTextDocument::find() with a QString, but with the
+// LiteralSearch kernel doing the searching within each block.
+static QTextCursor documentFind(QTextDocument *document, const LiteralSearch::Pattern &pattern,
+                                const QTextCursor &start, QTextDocument::FindFlags flags)
+{
+    const bool backward = flags.testFlag(QTextDocument::FindBackward);
+    const bool wholeWords = flags.testFlag(QTextDocument::FindWholeWords);
+    const int length = static_cast<int>(pattern.text.size());
+
+    int pos = 0;
+    if (!start.isNull())
+        pos = backward ? start.selectionStart() : start.selectionEnd();
+    // A backward search doesn't include the character after the cursor
+    if (backward && --pos < 0)
+        return QTextCursor();
+
+    QTextBlock block = document->findBlock(pos);
+    int offset = pos - block.position();
+    while (block.isValid()) {
+        const QString text = block.text();
+        int found = -1;
+        if (!backward) {
+            size_t from = static_cast<size_t>(offset);
+            for ( ;; ) {
+                const size_t idx = LiteralSearch::find(pattern, utf16Data(text), text.size(), from);
+                if (idx == LiteralSearch::NotFound)
+                    break;
+                if (!wholeWords || isWholeWord(text, int(idx), int(idx) + length)) {
+                    found = static_cast<int>(idx);
+                    break;
+                }
+                from = idx + length + 1;
+            }
+        } else if (offset >= 0) {
+            // Take the last match that starts at or before offset
+            size_t from = 0;
+            for ( ;; ) {
+                const size_t idx = LiteralSearch::find(pattern, utf16Data(text), text.size(), from);
+                if (idx == LiteralSearch::NotFound || idx > static_cast<size_t>(offset))
+                    break;
+                if (!wholeWords || isWholeWord(text, int(idx), int(idx) + length))
+                    found = static_cast<int>(idx);
+                from = idx + 1;
+            }
+        }
+
+        if (found >= 0) {
+            QTextCursor cursor(document);
+            cursor.setPosition(block.position() + found);
+            cursor.setPosition(block.position() + found + length, QTextCursor::KeepAnchor);
+            return cursor;
+        }
+        if (backward) {
+            block = block.previous();
+            offset = block.length() - 2;
+        } else {
+            block = block.next();
+            offset = 0;
+        }
+    }
+    return QTextCursor();
+}
+
 template <typename Findable>
 QTextCursor safeFindNext(QTextDocument *document, const Findable &search,
                          const QTextCursor &start, QTextDocument::FindFlags flags,
@@ -505,20 +695,108 @@ QTextCursor safeFindNext(QTextDocument *document, const Findable &search,
     // to find the next match (which could be equal to the skipped cursor).
     // Otherwise, certain types of searches could result in an infinite loop.
 
-    QTextCursor cursor = document->find(search, start, flags);
+    QTextCursor cursor = documentFind(document, search, start, flags);
     if (cursor == start && !matchFirst) {
         if (cursor.atEnd())
             return QTextCursor();
         cursor.movePosition(QTextCursor::NextCharacter);
-        cursor = document->find(search, cursor, flags);
+        cursor = documentFind(document, search, cursor, flags);
     }
     return cursor;
 }
 
+static const QString &regexLimitPrefix()
+{
+    static const QString s_prefix = QStringLiteral("(*LIMIT_MATCH=%1)").arg(REGEX_MATCH_LIMIT);
+    return s_prefix;
+}
+
+QRegularExpression SyntaxTextEdit::cachedRegex(const QString &pattern,
+                                               QRegularExpression::PatternOptions options)
+{
+    struct CacheEntry
+    {
+        QString pattern;
+        QRegularExpression::PatternOptions options;
+        QRegularExpression regex;
+    };
+
+    // Most recently used first.  QRegularExpression is implicitly shared,
+    // so every copy handed out uses the same compiled (and JIT'd) code.
+    static QList<CacheEntry> s_cache;
+    static QMutex s_cacheMutex;
+
+    QMutexLocker locker(&s_cacheMutex);
+    for (int i = 0; i < s_cache.size(); ++i) {
+        if (s_cache.at(i).pattern == pattern && s_cache.at(i).options == options) {
+            if (i != 0)
+                s_cache.move(i, 0);
+            return s_cache.first().regex;
+        }
+    }
+
+    QRegularExpression regex(regexLimitPrefix() + pattern, options);
+    regex.optimize();
+    if (s_cache.size() >= REGEX_CACHE_SIZE)
+        s_cache.removeLast();
+    s_cache.prepend(CacheEntry{pattern, options, regex});
+    return regex;
+}
+
+// Search patterns are always compiled in multi-line mode.  That makes no
+// difference within a single block, but lets ^ and $ match at the line
+// breaks when searching the whole document at once.
+static QRegularExpression::PatternOptions searchOptions(const SyntaxTextEdit::SearchParams &params)
+{
+    return params.caseSensitive ? QRegularExpression::MultilineOption
+                                : QRegularExpression::MultilineOption
+                                  | QRegularExpression::CaseInsensitiveOption;
+}
+
+bool SyntaxTextEdit::isMultiLineSearch(const SearchParams &params)
+{
+    if (params.searchText.contains(QLatin1Char('\n')))
+        return true;
+    if (!params.regex)
+        return false;
+
+    const QString &pattern = params.searchText;
+    for (int i = 0; i + 1 < pattern.size(); ++i) {
+        if (pattern.at(i) != QLatin1Char('\\'))
+            continue;
+        const QChar next = pattern.at(++i);
+        if (next == QLatin1Char('n') || next == QLatin1Char('r'))
+            return true;
+    }
+    return false;
+}
+
+QString SyntaxTextEdit::searchSnapshot() const
+{
+    QString text = document()->toRawText();
+    text.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+    return text;
+}
+
+QString SyntaxTextEdit::searchError(const SearchParams &params)
+{
+    if (!params.regex || params.searchText.isEmpty())
+        return QString();
+
+    const QRegularExpression re = cachedRegex(params.searchText, searchOptions(params));
+    if (re.isValid())
+        return QString();
+    const int offset = qMax(re.patternErrorOffset() - regexLimitPrefix().size(), 0);
+    return tr("%1 (at offset %2)").arg(re.errorString()).arg(offset);
+}
+
 QTextCursor SyntaxTextEdit::textSearch(const QTextCursor &start, const SearchParams &params,
                                        bool matchFirst, bool reverse,
                                        QRegularExpressionMatch *regexMatch)
 {
+    if (isMultiLineSearch(params))
+        return multiLineSearch(start, params, matchFirst, reverse, regexMatch);
+
     QTextDocument::FindFlags flags;
     if (params.caseSensitive)
         flags |= QTextDocument::FindCaseSensitively;
@@ -528,10 +806,9 @@ QTextCursor SyntaxTextEdit::textSearch(const QTextCursor &start, const SearchPar
         flags |= QTextDocument::FindBackward;
 
     if (params.regex) {
-        QRegularExpression::PatternOptions csOption = params.caseSensitive
-                                                    ? QRegularExpression::NoPatternOption
-                                                    : QRegularExpression::CaseInsensitiveOption;
-        const QRegularExpression re(params.searchText, csOption);
+        const QRegularExpression re = cachedRegex(params.searchText, searchOptions(params));
+        if (!re.isValid())
+            return QTextCursor();
         QTextCursor cursor = safeFindNext(document(), re, start, flags, matchFirst);
         if (cursor.isNull())
             return cursor;
@@ -539,48 +816,510 @@ QTextCursor SyntaxTextEdit::textSearch(const QTextCursor &start, const SearchPar
             *regexMatch = re.match(cursor.selectedText());
         return cursor;
     } else {
+        LiteralSearch::Pattern literal;
+        if (compileLiteral(params, &literal))
+            return safeFindNext(document(), literal, start, flags, matchFirst);
         return safeFindNext(document(), params.searchText, start, flags, matchFirst);
     }
 }
 
+// QTextDocument::find() only matches within a block, so patterns which can
+// match a line break are run over a snapshot of the whole document instead,
+// with the block separators replaced by '\n'.  Positions in the snapshot
+// are the same as positions in the document.
+QTextCursor SyntaxTextEdit::multiLineSearch(const QTextCursor &start, const SearchParams &params,
+                                            bool matchFirst, bool reverse,
+                                            QRegularExpressionMatch *regexMatch)
+{
+    const QString pattern = params.regex ? params.searchText
+                                         : QRegularExpression::escape(params.searchText);
+    const QRegularExpression re = cachedRegex(pattern, searchOptions(params));
+    if (!re.isValid())
+        return QTextCursor();
+
+    QString text = searchSnapshot();
+    text.replace(QChar::Nbsp, QLatin1Char(' '));
+
+    // Same rules as safeFindNext(): the match at the start cursor itself
+    // doesn't count unless matchFirst is set.
+    const int startPos = start.isNull() ? 0 : start.selectionStart();
+    const int startEnd = start.isNull() ? 0 : start.selectionEnd();
+    const int limit = reverse ? startPos : text.size();
+    QRegularExpressionMatch found;
+    int offset = reverse ? 0 : startEnd;
+    while (offset <= limit) {
+        const QRegularExpressionMatch match = re.match(text, offset);
+        if (!match.hasMatch() || match.capturedStart() > limit)
+            break;
+
+        const int pos = match.capturedStart();
+        const int end = match.capturedEnd();
+        offset = (end > pos) ? end : pos + 1;
+        if (params.wholeWord
+                && ((pos != 0 && text.at(pos - 1).isLetterOrNumber())
+                    || (end != text.size() && text.at(end).isLetterOrNumber()))) {
+            offset = end + 1;
+            continue;
+        }
+        if (!matchFirst && pos == startPos && end == startEnd)
+            continue;
+
+        found = match;
+        if (!reverse)
+            break;
+    }
+    if (!found.hasMatch())
+        return QTextCursor();
+
+    QTextCursor cursor(document());
+    cursor.setPosition(found.capturedStart());
+    cursor.setPosition(found.capturedEnd(), QTextCursor::KeepAnchor);
+    if (regexMatch)
+        *regexMatch = found;
+    return cursor;
+}
+
+bool SyntaxTextEdit::findMatchesInText(const QString &text, const SearchParams &params,
+                                       std::vector<SearchMatch> *matches, int start, int end,
+                                       std::vector<QRegularExpressionMatch> *regexMatches)
+{
+    const QRegularExpression re = params.regex
+                                ? cachedRegex(params.searchText, searchOptions(params))
+                                : QRegularExpression();
+    if (end < 0)
+        end = text.size();
+    if (isMultiLineSearch(params) || !params.regex) {
+        // Plain text can't cross a line unless it's a multi-line search, so
+        // there's no need to split it up.
+        if (!findMatches(text, 0, params, re, matches, start, regexMatches))
+            return false;
+    } else {
+        int lineStart = (start > 0) ? text.lastIndexOf(QLatin1Char('\n'), start - 1) + 1 : 0;
+        for ( ;; ) {
+            int lineEnd = text.indexOf(QLatin1Char('\n'), lineStart);
+            if (lineEnd < 0)
+                lineEnd = text.size();
+            if (!findMatches(text.mid(lineStart, lineEnd - lineStart), lineStart, params, re,
+                             matches, qMax(start - lineStart, 0), regexMatches)) {
+                return false;
+            }
+            if (lineEnd >= end)
+                break;
+            lineStart = lineEnd + 1;
+        }
+    }
+
+    // Matches are in order, and can't overlap, so the ones that extend past
+    // the end are all at the end.
+    while (!matches->empty() && matches->back().start + matches->back().length > end) {
+        matches->pop_back();
+        if (regexMatches && !regexMatches->empty())
+            regexMatches->pop_back();
+    }
+    return true;
+}
+
+bool SyntaxTextEdit::findAllMatches(const SearchParams &params, int start, int end,
+                                    std::vector<SearchMatch> *matches,
+                                    std::vector<QRegularExpressionMatch> *regexMatches)
+{
+    return findMatchesInText(searchSnapshot(), params, matches, start, end, regexMatches);
+}
+
 void SyntaxTextEdit::setLiveSearch(const SearchParams &params)
 {
     m_liveSearch = params;
+    m_liveSearchRegex = params.regex ? cachedRegex(params.searchText, searchOptions(params))
+                                     : QRegularExpression();
+    m_liveSearchMultiLine = isMultiLineSearch(params);
     updateLiveSearch();
 }
 
 void SyntaxTextEdit::clearLiveSearch()
 {
     m_liveSearch.searchText = QString();
+    m_liveSearchRegex = QRegularExpression();
     updateLiveSearch();
 }
 
 void SyntaxTextEdit::updateLiveSearch()
 {
-    if (m_searchResults.isEmpty() && m_liveSearch.searchText.isEmpty())
+    m_liveSearchLength = document()->characterCount();
+    m_liveSearchRestartTimer->stop();
+    if (m_searchMatches.empty() && !m_searchWorker && m_liveSearch.searchText.isEmpty())
+        return;
+
+    // Rescanning after every batch would be quadratic; we update once the
+    // document is fully populated instead.
+    if (isPopulating())
         return;
 
-    m_searchResults.clear();
-    if (!m_liveSearch.searchText.isEmpty()) {
-        auto searchCursor = textCursor();
-        searchCursor.movePosition(QTextCursor::Start);
-        searchCursor = textSearch(searchCursor, m_liveSearch, true);
-        while (!searchCursor.isNull()) {
-            if (searchCursor.hasSelection()) {
-                QTextEdit::ExtraSelection selection;
-                selection.format.setBackground(m_searchBg);
-                selection.cursor = searchCursor;
-                m_searchResults.append(selection);
+    cancelSearchWorker();
+    m_searchMatches.clear();
+    m_searchShiftIndex = 0;
+    m_searchShift = 0;
+    m_liveSearchError.clear();
+    if (!m_liveSearch.searchText.isEmpty()
+            && (!m_liveSearch.regex || m_liveSearchRegex.isValid())) {
+        if (m_liveSearchLength > LIVE_SEARCH_SYNC_LENGTH) {
+            startSearchWorker();
+        } else if (m_liveSearchMultiLine || !m_liveSearch.regex) {
+            // Plain text is searched in one go, which lets the literal
+            // search kernel run over the whole document at once.
+            if (!findMatches(searchSnapshot(), 0, m_liveSearch, m_liveSearchRegex,
+                             &m_searchMatches)) {
+                setLiveSearchError();
+                return;
+            }
+        } else {
+            const QDeadlineTimer deadline(LIVE_SEARCH_SYNC_TIME);
+            switch (findLiveMatches(document()->begin(), document()->lastBlock(),
+                                    &m_searchMatches, deadline)) {
+            case LiveSearchTooComplex:
+                setLiveSearchError();
+                return;
+            case LiveSearchTimedOut:
+                // Don't hold up typing; finish it in the background instead
+                m_searchMatches.clear();
+                startSearchWorker();
+                break;
+            case LiveSearchDone:
+                break;
             }
-            searchCursor = textSearch(searchCursor, m_liveSearch, false);
         }
     }
-    updateExtraSelections();
+    viewport()->update();
+    emit liveSearchMatchesChanged();
+}
+
+void SyntaxTextEdit::startSearchWorker()
+{
+    m_searchWorker = new LiveSearchWorker(searchSnapshot(), m_liveSearch,
+                                          m_liveSearchRegex, m_liveSearchMultiLine, this);
+    m_searchDirtyStart = -1;
+    m_searchDirtyEnd = -1;
+
+    LiveSearchWorker *worker = m_searchWorker;
+    connect(worker, &QThread::finished, this, [this, worker] {
+        if (worker == m_searchWorker)
+            mergeSearchWorker();
+        worker->deleteLater();
+    });
+    worker->start(QThread::LowPriority);
+}
+
+void SyntaxTextEdit::cancelSearchWorker()
+{
+    if (m_searchWorker) {
+        m_searchWorker->cancel();
+        m_searchWorker = nullptr;
+    }
+}
+
+// The worker's matches are from the snapshot.  Anything edited since then
+// is inside the dirty range, so those blocks are searched again, and the
+// matches after them are moved to match the current document.
+void SyntaxTextEdit::mergeSearchWorker()
+{
+    Q_ASSERT(m_searchWorker);
+
+    if (m_searchWorker->tooComplex()) {
+        setLiveSearchError();
+        return;
+    }
+
+    m_searchMatches = m_searchWorker->takeMatches();
+    m_searchShiftIndex = 0;
+    m_searchShift = 0;
+    if (m_searchDirtyStart >= 0) {
+        const int lengthDelta = document()->characterCount() - m_searchWorker->documentLength();
+        const size_t replaceBegin = findSearchMatch(m_searchDirtyStart);
+        const size_t replaceEnd = findSearchMatch(m_searchDirtyEnd - lengthDelta, replaceBegin);
+
+        const QTextBlock first = document()->findBlock(m_searchDirtyStart);
+        QTextBlock last = document()->findBlock(m_searchDirtyEnd - 1);
+        if (!last.isValid())
+            last = document()->lastBlock();
+        std::vector<SearchMatch> found;
+        if (findLiveMatches(first, last, &found) == LiveSearchTooComplex) {
+            setLiveSearchError();
+            return;
+        }
+
+        auto iter = m_searchMatches.erase(m_searchMatches.begin() + replaceBegin,
+                                          m_searchMatches.begin() + replaceEnd);
+        m_searchMatches.insert(iter, found.cbegin(), found.cend());
+        m_searchShiftIndex = replaceBegin + found.size();
+        m_searchShift = lengthDelta;
+    }
+    m_searchWorker = nullptr;
+
+    viewport()->update();
+    emit liveSearchMatchesChanged();
+}
+
+QString SyntaxTextEdit::liveSearchError() const
+{
+    return m_liveSearchError;
+}
+
+int SyntaxTextEdit::liveSearchMatchCount() const
+{
+    if (m_searchWorker || m_liveSearchRestartTimer->isActive())
+        return -1;
+    return static_cast<int>(m_searchMatches.size());
+}
+
+int SyntaxTextEdit::liveSearchMatchIndex(const QTextCursor &cursor) const
+{
+    if (m_searchWorker || m_liveSearchRestartTimer->isActive() || !cursor.hasSelection())
+        return -1;
+
+    const size_t index = findSearchMatch(cursor.selectionStart());
+    if (index >= m_searchMatches.size() || searchMatchStart(index) != cursor.selectionStart()
+            || m_searchMatches[index].length != cursor.selectionEnd() - cursor.selectionStart())
+        return -1;
+    return static_cast<int>(index);
+}
+
+// Called for every edit while a live search is active.  Matches can't span
+// more than one block, so only the blocks touched by the edit need to be
+// searched again; the matches after them are just moved.  Like the encoding
+// tracker, we don't trust charsRemoved, and use the change in the document
+// length instead.
+void SyntaxTextEdit::liveSearchContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+
+    const int docLength = document()->characterCount();
+    const int lengthDelta = docLength - m_liveSearchLength;
+    m_liveSearchLength = docLength;
+
+    if (m_liveSearch.searchText.isEmpty() || !m_liveSearchError.isEmpty())
+        return;
+    if (isPopulating()) {
+        // Everything will be searched again once the document is complete
+        cancelSearchWorker();
+        m_searchMatches.clear();
+        return;
+    }
+    if (m_liveSearchMultiLine) {
+        // A match could start or end anywhere, so it's simplest to start
+        // over.  For a large document, that means copying and searching all
+        // of it again, so wait for a pause in editing first.
+        if (docLength > LIVE_SEARCH_SYNC_LENGTH) {
+            cancelSearchWorker();
+            if (!m_searchMatches.empty()) {
+                m_searchMatches.clear();
+                viewport()->update();
+            }
+            m_liveSearchRestartTimer->start();
+            emit liveSearchMatchesChanged();
+        } else {
+            updateLiveSearch();
+        }
+        return;
+    }
+
+    const QTextBlock first = document()->findBlock(position);
+    QTextBlock last = document()->findBlock(position + charsAdded);
+    if (!last.isValid())
+        last = document()->lastBlock();
+    if (!first.isValid() || !last.isValid()) {
+        updateLiveSearch();
+        return;
+    }
+
+    const int startPos = first.position();
+    const int newEndPos = last.position() + last.length();
+    const int oldEndPos = newEndPos - lengthDelta;
+    if (oldEndPos < startPos) {
+        updateLiveSearch();
+        return;
+    }
+
+    if (m_searchWorker) {
+        // Grow the dirty range to cover this edit as well
+        if (m_searchDirtyStart < 0) {
+            m_searchDirtyStart = startPos;
+            m_searchDirtyEnd = newEndPos;
+        } else {
+            if (m_searchDirtyStart >= oldEndPos)
+                m_searchDirtyStart += lengthDelta;
+            if (m_searchDirtyEnd >= oldEndPos)
+                m_searchDirtyEnd += lengthDelta;
+            else if (m_searchDirtyEnd > startPos)
+                m_searchDirtyEnd = newEndPos;
+            m_searchDirtyStart = qMin(m_searchDirtyStart, startPos);
+            m_searchDirtyEnd = qMax(m_searchDirtyEnd, newEndPos);
+        }
+        if (m_searchDirtyEnd - m_searchDirtyStart > LIVE_SEARCH_SYNC_LENGTH)
+            updateLiveSearch();
+        return;
+    }
+
+    const size_t replaceBegin = findSearchMatch(startPos);
+    const size_t replaceEnd = findSearchMatch(oldEndPos, replaceBegin);
+
+    // Move the pending shift to start right after the replaced matches, so
+    // the delta from this edit can simply be added to it.  This only touches
+    // the matches between this edit and the previous one.
+    if (m_searchShift != 0) {
+        if (m_searchShiftIndex < replaceEnd) {
+            for (size_t i = m_searchShiftIndex; i < replaceEnd; ++i)
+                m_searchMatches[i].start += m_searchShift;
+        } else {
+            for (size_t i = replaceEnd; i < m_searchShiftIndex; ++i)
+                m_searchMatches[i].start -= m_searchShift;
+        }
+    }
+    m_searchShift += lengthDelta;
+
+    std::vector<SearchMatch> found;
+    if (findLiveMatches(first, last, &found) == LiveSearchTooComplex) {
+        setLiveSearchError();
+        return;
+    }
+
+    auto iter = m_searchMatches.erase(m_searchMatches.begin() + replaceBegin,
+                                      m_searchMatches.begin() + replaceEnd);
+    m_searchMatches.insert(iter, found.cbegin(), found.cend());
+    m_searchShiftIndex = replaceBegin + found.size();
+
+    if (found.size() != replaceEnd - replaceBegin)
+        emit liveSearchMatchesChanged();
+}
+
+// Returns the index of the first match starting at or after position,
+// searching from index first.
+size_t SyntaxTextEdit::findSearchMatch(int position, size_t first) const
+{
+    size_t count = m_searchMatches.size() - first;
+    while (count > 0) {
+        const size_t step = count / 2;
+        if (searchMatchStart(first + step) < position) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return first;
+}
+
+bool SyntaxTextEdit::findMatches(QString text, int position, const SearchParams &params,
+                                 const QRegularExpression &regex,
+                                 std::vector<SearchMatch> *matches, int from,
+                                 std::vector<QRegularExpressionMatch> *regexMatches,
+                                 const std::function<bool ()> &interrupted)
+{
+    const Qt::CaseSensitivity cs = params.caseSensitive ? Qt::CaseSensitive
+                                                        : Qt::CaseInsensitive;
+    QRegularExpressionMatch regexMatch;
+    LiteralSearch::Pattern literal;
+    const bool useLiteral = !params.regex && compileLiteral(params, &literal);
+    // The literal search's fold table already treats these as spaces
+    if (!useLiteral)
+        text.replace(QChar::Nbsp, QLatin1Char(' '));
+
+    int offset = from;
+    int lastEnd = -1;
+    int checkCountdown = SEARCH_INTERRUPT_MATCHES;
+    qint64 checkOffset = static_cast<qint64>(offset) + SEARCH_INTERRUPT_DISTANCE;
+    while (offset <= text.size()) {
+        if (interrupted && (--checkCountdown == 0 || offset >= checkOffset)) {
+            if (interrupted())
+                break;
+            checkCountdown = SEARCH_INTERRUPT_MATCHES;
+            checkOffset = static_cast<qint64>(offset) + SEARCH_INTERRUPT_DISTANCE;
+        }
+
+        int pos, length;
+        if (params.regex) {
+            regexMatch = regex.match(text, offset);
+            if (!regexMatch.hasMatch()) {
+                // An invalid result means PCRE gave up, most likely from
+                // hitting the match limit.
+                if (!regexMatch.isValid())
+                    return false;
+                break;
+            }
+            pos = regexMatch.capturedStart();
+            length = regexMatch.capturedLength();
+        } else if (useLiteral) {
+            const size_t found = LiteralSearch::find(literal, utf16Data(text), text.size(), offset);
+            pos = (found == LiteralSearch::NotFound) ? -1 : static_cast<int>(found);
+            length = params.searchText.size();
+        } else {
+            pos = text.indexOf(params.searchText, offset, cs);
+            length = params.searchText.size();
+        }
+        if (pos < 0)
+            break;
+
+        const int end = pos + length;
+        if (params.wholeWord
+                && ((pos != 0 && text.at(pos - 1).isLetterOrNumber())
+                    || (end != text.size() && text.at(end).isLetterOrNumber()))) {
+            // Same as QTextDocument::find()
+            offset = end + 1;
+            continue;
+        }
+        if (length == 0) {
+            // Empty matches aren't highlighted, but they can be replaced
+            // (e.g. "^"), except right at the end of the previous match.
+            if (regexMatches && pos != lastEnd) {
+                matches->push_back(SearchMatch{position + pos, 0});
+                regexMatches->push_back(regexMatch);
+            }
+            offset = pos + 1;
+            continue;
+        }
+        matches->push_back(SearchMatch{position + pos, length});
+        if (regexMatches)
+            regexMatches->push_back(regexMatch);
+        offset = end;
+        lastEnd = end;
+    }
+    return true;
+}
+
+// Searches the blocks from block through last the same way textSearch()
+// would, and appends each non-empty match to matches.
+SyntaxTextEdit::LiveSearchResult
+SyntaxTextEdit::findLiveMatches(QTextBlock block, const QTextBlock &last,
+                                std::vector<SearchMatch> *matches,
+                                const QDeadlineTimer &deadline) const
+{
+    if (m_liveSearch.regex && !m_liveSearchRegex.isValid())
+        return LiveSearchDone;
+
+    while (block.isValid()) {
+        if (!findMatches(block.text(), block.position(), m_liveSearch, m_liveSearchRegex, matches))
+            return LiveSearchTooComplex;
+        if (block == last)
+            break;
+        if (deadline.hasExpired())
+            return LiveSearchTimedOut;
+        block = block.next();
+    }
+    return LiveSearchDone;
+}
+
+void SyntaxTextEdit::setLiveSearchError()
+{
+    cancelSearchWorker();
+    m_searchMatches.clear();
+    m_searchShiftIndex = 0;
+    m_searchShift = 0;
+    m_liveSearchError = tr("The search pattern is too complex");
+    viewport()->update();
+    emit liveSearchMatchesChanged();
 }
 
 void SyntaxTextEdit::updateExtraSelections()
 {
-    setExtraSelections(m_braceMatch + m_searchResults);
+    setExtraSelections(m_braceMatch);
 }
 
 void SyntaxTextEdit::setMatchBraces(bool match)
@@ -654,9 +1393,6 @@ void SyntaxTextEdit::setTheme(const KSyntaxHighlighting::Theme &theme)
     m_highlighter->setTheme(theme);
     m_highlighter->rehighlight();
 
-    // Update extra highlights to match the new theme
-    for (auto &result : m_searchResults)
-        result.format.setBackground(m_searchBg);
     updateTextMetrics();
     updateCursor();
 }
@@ -1099,6 +1835,98 @@ void SyntaxTextEdit::unfoldAll()
     ensureCursorVisible();
 }
 
+// Returns the position just past the count'th line break starting at start,
+// or the end of the text if there are fewer line breaks than that.  This
+// matches the separators recognized by QTextCursor::insertText(), and never
+// splits a CR+LF pair.
+static int skipLines(const QString &text, int start, int count)
+{
+    const QChar *data = text.constData();
+    const int size = text.size();
+    for (int i = start; i < size; ++i) {
+        const QChar ch = data[i];
+        if (ch == QLatin1Char('\n') || ch == QChar::ParagraphSeparator
+                || (ch == QLatin1Char('\r') && (i + 1 == size || data[i + 1] != QLatin1Char('\n')))) {
+            if (--count == 0)
+                return i + 1;
+        }
+    }
+    return size;
+}
+
+void SyntaxTextEdit::populatePlainText(const QString &text)
+{
+    stopPopulation();
+
+    const int split = skipLines(text, 0, POPULATE_INITIAL_LINES);
+    if (split >= text.size()) {
+        setPlainText(text);
+        return;
+    }
+
+    // Appending the remaining batches should not generate undo commands
+    m_populateText = text;
+    m_populateOffset = split;
+    m_populateReadOnly = isReadOnly();
+    setReadOnly(true);
+    document()->setUndoRedoEnabled(false);
+    setPlainText(text.left(split));
+    m_populateTimer->start();
+}
+
+void SyntaxTextEdit::populateNextBatch()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::End);
+    while (m_populateOffset < m_populateText.size()) {
+        const int end = skipLines(m_populateText, m_populateOffset, POPULATE_BATCH_LINES);
+        cursor.insertText(m_populateText.mid(m_populateOffset, end - m_populateOffset));
+        m_populateOffset = end;
+        if (timer.elapsed() >= POPULATE_TIME_SLICE)
+            break;
+    }
+
+    if (m_populateOffset >= m_populateText.size()) {
+        stopPopulation();
+        emit populationFinished();
+        updateLiveSearch();
+    }
+}
+
+void SyntaxTextEdit::finishPopulation()
+{
+    if (!isPopulating())
+        return;
+
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(m_populateText.mid(m_populateOffset));
+    stopPopulation();
+    emit populationFinished();
+    updateLiveSearch();
+}
+
+void SyntaxTextEdit::stopPopulation()
+{
+    if (!isPopulating())
+        return;
+
+    m_populateTimer->stop();
+    m_populateText.clear();
+    m_populateOffset = 0;
+    document()->setUndoRedoEnabled(true);
+    setReadOnly(m_populateReadOnly);
+}
+
+void SyntaxTextEdit::clear()
+{
+    stopPopulation();
+    QPlainTextEdit::clear();
+}
+
 void SyntaxTextEdit::zoomIn()
 {
     QPlainTextEdit::zoomIn(1);
@@ -1384,6 +2212,10 @@ void SyntaxTextEdit::paintEvent(QPaintEvent *e)
         }
     }
 
+    // Search highlights go under the text, the same as extra selections
+    if (!m_searchMatches.empty() || m_searchWorker)
+        paintSearchMatches(eventRect);
+
     QTextBlock block = firstVisibleBlock();
     while (block.isValid()) {
         QRectF blockRect = blockBoundingGeometry(block).translated(contentOffset());
@@ -1453,8 +2285,68 @@ void SyntaxTextEdit::paintEvent(QPaintEvent *e)
     }
 }
 
+void SyntaxTextEdit::paintSearchMatches(const QRect &eventRect)
+{
+    QPainter p(viewport());
+    const QPointF offset = contentOffset();
+
+    // While the background search is running, the visible blocks are
+    // searched as they're painted instead.  That's not possible for a
+    // multi-line search, which just shows nothing until it's done.
+    if (m_searchWorker && m_liveSearchMultiLine)
+        return;
+    const bool searching = (m_searchWorker != nullptr);
+    std::vector<SearchMatch> blockMatches;
+    QTextBlock block = firstVisibleBlock();
+    size_t index = 0;
+    for ( ; block.isValid(); block = block.next()) {
+        if (!searching && index >= m_searchMatches.size())
+            break;
+        if (!block.isVisible())
+            continue;
+
+        const QRectF blockRect = blockBoundingGeometry(block).translated(offset);
+        if (blockRect.top() > eventRect.bottom())
+            break;
+
+        const int blockStart = block.position();
+        blockMatches.clear();
+        if (searching) {
+            findMatches(block.text(), blockStart, m_liveSearch, m_liveSearchRegex, &blockMatches);
+        } else {
+            const int blockEnd = blockStart + block.length();
+            for (index = findSearchMatch(blockStart, index); index < m_searchMatches.size(); ++index) {
+                const int matchStart = searchMatchStart(index);
+                if (matchStart >= blockEnd)
+                    break;
+                blockMatches.push_back(SearchMatch{matchStart, m_searchMatches[index].length});
+            }
+        }
+
+        const QTextLayout *layout = block.layout();
+        for (const auto &match : blockMatches) {
+            const int matchStart = match.start - blockStart;
+            const int matchEnd = matchStart + match.length;
+            for (int i = 0; i < layout->lineCount(); ++i) {
+                const QTextLine line = layout->lineAt(i);
+                const int lineStart = line.textStart();
+                const int lineEnd = lineStart + line.textLength();
+                if (matchEnd <= lineStart || matchStart >= lineEnd)
+                    continue;
+                const qreal left = line.cursorToX(qMax(matchStart, lineStart));
+                const qreal right = line.cursorToX(qMin(matchEnd, lineEnd));
+                const QRectF matchRect(QPointF(left, line.y()),
+                                       QPointF(right, line.y() + line.height()));
+                p.fillRect(matchRect.normalized().translated(blockRect.topLeft()), m_searchBg);
+            }
+        }
+    }
+}
+
 void SyntaxTextEdit::printDocument(QPrinter *printer)
 {
+    finishPopulation();
+
     // Override settings for printing
     auto displayFont = font();
     setFont(defaultFont());
@@ -18,6 +18,11 @@
 #define QTEXTPAD_SYNTAXTEXTEDIT_H
 
 #include <QPlainTextEdit>
+#include <QRegularExpression>
+#include <QDeadlineTimer>
+
+#include <functional>
+#include <vector>
 
 namespace KSyntaxHighlighting
 {
@@ -28,7 +33,10 @@ namespace KSyntaxHighlighting
 
 class SyntaxHighlighter;
 
+class LiveSearchWorker;
+
 class QPrinter;
+class QTimer;
 
 class SyntaxTextEdit : public QPlainTextEdit
 {
@@ -36,6 +44,7 @@ class SyntaxTextEdit : public QPlainTextEdit
 
 public:
     explicit SyntaxTextEdit(QWidget *parent = nullptr);
+    ~SyntaxTextEdit() Q_DECL_OVERRIDE;
 
     void deleteSelection();
     void deleteLines();
@@ -96,12 +105,76 @@ public:
 
         SearchParams() : caseSensitive(), wholeWord(), regex() { }
     };
+    // Returns a user-readable description of why the search pattern can't
+    // be used, or an empty string if it's fine.
+    static QString searchError(const SearchParams &params);
+
+    // Compiled patterns are cached, so searching for the same pattern again
+    // (e.g. once per match in Replace All) doesn't recompile it.
+    static QRegularExpression cachedRegex(const QString &pattern,
+                                          QRegularExpression::PatternOptions options);
+
+    // Searches for text that can span more than one line (i.e. containing
+    // a newline, or a \n or \r regex escape) run over the whole document
+    // instead of one block at a time.
+    static bool isMultiLineSearch(const SearchParams &params);
+
     QTextCursor textSearch(const QTextCursor &start, const SearchParams& params,
                            bool matchFirst, bool reverse = false,
                            QRegularExpressionMatch *regexMatch = nullptr);
     void setLiveSearch(const SearchParams& params);
     void clearLiveSearch();
 
+    // Large documents are searched in the background, in which case the
+    // count is -1 until the search has finished.  Only the visible part of
+    // the document is highlighted until then.
+    int liveSearchMatchCount() const;
+
+    // Index of the live search match that is selected by cursor, or -1
+    int liveSearchMatchIndex(const QTextCursor &cursor) const;
+
+    // Set if the live search had to give up, e.g. on a regex that needs
+    // too much backtracking.  There are no matches in that case.
+    QString liveSearchError() const;
+
+    struct SearchMatch
+    {
+        int start, length;
+    };
+
+    // Appends the matches in a single block of text, starting from index
+    // from, the same way QTextDocument::find() would find them.  position
+    // is the position of the start of text in the document.  If
+    // regexMatches is set, it gets the match details for each match, and
+    // empty matches are included as well.  Returns false if the regex
+    // exceeded its match limit, in which case the results are incomplete.
+    // If interrupted is set, it's checked every so often during the search,
+    // which stops early (with incomplete results) once it returns true.
+    static bool findMatches(QString text, int position, const SearchParams &params,
+                            const QRegularExpression &regex,
+                            std::vector<SearchMatch> *matches, int from = 0,
+                            std::vector<QRegularExpressionMatch> *regexMatches = nullptr,
+                            const std::function<bool ()> &interrupted = {});
+
+    // Finds every match between positions start and end (or the end of the
+    // text if negative) in text with '\n' between lines, such as
+    // searchSnapshot().  As with findMatches(), empty matches are only
+    // included with regexMatches.  Returns false if the regex exceeded its
+    // match limit.
+    static bool findMatchesInText(const QString &text, const SearchParams &params,
+                                  std::vector<SearchMatch> *matches,
+                                  int start = 0, int end = -1,
+                                  std::vector<QRegularExpressionMatch> *regexMatches = nullptr);
+
+    // The same, over the document's text.
+    bool findAllMatches(const SearchParams &params, int start, int end,
+                        std::vector<SearchMatch> *matches,
+                        std::vector<QRegularExpressionMatch> *regexMatches);
+
+    // The document's text, with '\n' between blocks.  Positions in the
+    // snapshot are the same as positions in the document.
+    QString searchSnapshot() const;
+
     void setMatchBraces(bool match);
     bool matchBraces() const;
 
@@ -124,6 +197,13 @@ public:
 
     QFont defaultFont() const;
 
+    // Load a large document progressively: the first few thousand lines are
+    // set immediately, and the rest is appended in small batches from the
+    // event loop.  The editor is read-only until population is finished.
+    void populatePlainText(const QString &text);
+    bool isPopulating() const { return !m_populateText.isEmpty(); }
+    void finishPopulation();
+
 protected:
     void resizeEvent(QResizeEvent *e) Q_DECL_OVERRIDE;
     void keyPressEvent(QKeyEvent *e) Q_DECL_OVERRIDE;
@@ -133,8 +213,12 @@ protected:
 signals:
     void undoRequested();
     void redoRequested();
+    void populationFinished();
+    void liveSearchMatchesChanged();
 
 public slots:
+    void clear();       // Hides QPlainTextEdit::clear()
+
     void cutLines();
     void copyLines();
     void indentSelection();
@@ -158,7 +242,9 @@ private slots:
     void updateTabMetrics();
     void updateTextMetrics();
     void updateLiveSearch();
+    void liveSearchContentsChange(int position, int charsRemoved, int charsAdded);
     void updateExtraSelections();
+    void populateNextBatch();
 
 private:
     QWidget *m_lineMargin;
@@ -179,9 +265,57 @@ private:
 
     QPixmap m_foldOpen, m_foldClosed;
 
+    // Live search matches, sorted by position.  Rather than moving every
+    // match after an edit, the offset is kept in m_searchShift and applied
+    // to all of the matches from m_searchShiftIndex on when they're read.
     SearchParams m_liveSearch;
+    QRegularExpression m_liveSearchRegex;
+    bool m_liveSearchMultiLine;
+    std::vector<SearchMatch> m_searchMatches;
+    size_t m_searchShiftIndex;
+    int m_searchShift;
+    int m_liveSearchLength;
     QList<QTextEdit::ExtraSelection> m_braceMatch;
-    QList<QTextEdit::ExtraSelection> m_searchResults;
+    QString m_liveSearchError;
+    enum LiveSearchResult
+    {
+        LiveSearchDone,
+        LiveSearchTooComplex,
+        LiveSearchTimedOut,
+    };
+    LiveSearchResult findLiveMatches(QTextBlock block, const QTextBlock &last,
+                                     std::vector<SearchMatch> *matches,
+                                     const QDeadlineTimer &deadline = QDeadlineTimer(QDeadlineTimer::Forever)) const;
+    void setLiveSearchError();
+    QTextCursor multiLineSearch(const QTextCursor &start, const SearchParams &params,
+                                bool matchFirst, bool reverse,
+                                QRegularExpressionMatch *regexMatch);
+    size_t findSearchMatch(int position, size_t first = 0) const;
+    int searchMatchStart(size_t index) const
+    {
+        return m_searchMatches[index].start
+               + (index >= m_searchShiftIndex ? m_searchShift : 0);
+    }
+    void paintSearchMatches(const QRect &eventRect);
+
+    // While the worker is running, m_searchMatches is empty, and edits are
+    // tracked as a single range (in current document positions) which is
+    // searched again when the worker's results are merged in.
+    LiveSearchWorker *m_searchWorker;
+    int m_searchDirtyStart, m_searchDirtyEnd;
+
+    // Multi-line searches of large documents are restarted after a pause
+    // in editing, rather than on every edit.
+    QTimer *m_liveSearchRestartTimer;
+    void startSearchWorker();
+    void cancelSearchWorker();
+    void mergeSearchWorker();
+
+    QString m_populateText;
+    int m_populateOffset;
+    bool m_populateReadOnly;
+    QTimer *m_populateTimer;
+    void stopPopulation();
 
     void updateScrollBars();
 
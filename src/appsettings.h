@@ -72,6 +72,11 @@ public:
     SIMPLE_SETTING(bool, "Editor/ScrollPastEndOfFile", scrollPastEndOfFile,
                    setScrollPastEndOfFile, false)
 
+    // Files at least this large (in MiB) are opened in the read-only
+    // large file viewer.  0 disables the viewer.
+    SIMPLE_SETTING(int, "Editor/HugeFileThreshold", hugeFileThreshold,
+                   setHugeFileThreshold, 256)
+
     QFont editorFont() const;
     void setEditorFont(const QFont &font);
 
@@ -109,6 +114,14 @@ public:
     SIMPLE_SETTING(bool, "Search/Escapes", searchEscapes, setSearchEscapes, false)
     SIMPLE_SETTING(bool, "Search/Wrap", searchWrap, setSearchWrap, true)
 
+    // Find in Files options
+    SIMPLE_SETTING(QString, "Search/FilesDirectory", searchFilesDirectory,
+                   setSearchFilesDirectory, QString())
+    SIMPLE_SETTING(QString, "Search/FilesInclude", searchFilesInclude,
+                   setSearchFilesInclude, QString())
+    SIMPLE_SETTING(QString, "Search/FilesExclude", searchFilesExclude,
+                   setSearchFilesExclude, QStringLiteral(".git .hg .svn"))
+
 private:
     QSettings m_settings;
 };
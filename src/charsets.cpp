@@ -15,19 +15,46 @@
  */
 
 #include "charsets.h"
+#include "textkernels.h"
 
 #include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QLoggingCategory>
 #include <QMap>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
 
 #ifdef QTEXTPAD_USE_WIN10_ICU
 #include <icu.h>
 #else
 #include <unicode/ucnv.h>
+#include <unicode/ucsdet.h>
+#include <unicode/uset.h>
 #endif
 
 Q_LOGGING_CATEGORY(CsLog, "qtextpad.charsets", QtInfoMsg)
 
+#define DECODE_CHUNK_SIZE       (4*1024*1024)
+#define CONVERTER_POOL_SIZE     8
+
+#define PARALLEL_DECODE_MIN_SIZE    (32*1024*1024)
+#define PARALLEL_CHUNK_MIN_SIZE     (4*1024*1024)
+#define PARALLEL_CHUNKS_PER_THREAD  4
+#define PARALLEL_PROGRESS_INTERVAL  50      // milliseconds
+#define VALIDATE_BUFFER_SIZE    1024
+
+#define DETECT_CHUNK_SIZE       (4*1024)
+#define DETECT_FIRST_CHUNKS     4
+#define DETECT_MAX_CHUNKS       64
+#define DETECT_CONFIDENT        80
+#define DETECT_TIME_BUDGET      50      // milliseconds
+
 struct TextCodecCache
 {
     ~TextCodecCache()
@@ -37,11 +64,14 @@ struct TextCodecCache
     }
 
     QMap<QByteArray, TextCodec *> m_cache;
+    QMutex m_lock;
 };
 static TextCodecCache s_codecs;
 
 TextCodec *TextCodec::create(const QByteArray &name)
 {
+    // Codecs may be looked up from the background document loader
+    QMutexLocker locker(&s_codecs.m_lock);
     if (s_codecs.m_cache.contains(name))
         return s_codecs.m_cache[name];
 
@@ -59,6 +89,58 @@ TextCodec *TextCodec::create(const QByteArray &name)
     return newCodec;
 }
 
+TextCodec::TextCodec(UConverter *converter, QByteArray name)
+    : m_converter(converter), m_name(std::move(name)), m_fastPath(NoFastPath),
+      m_splitMode(NoSplit), m_encodesAllUnicode()
+{
+    switch (ucnv_getType(m_converter)) {
+    case UCNV_UTF8:
+        m_fastPath = Utf8Path;
+        m_splitMode = SplitUtf8;
+        m_encodesAllUnicode = true;
+        break;
+    case UCNV_LATIN_1:
+        m_fastPath = Latin1Path;
+        m_splitMode = SplitAnywhere;
+        break;
+    case UCNV_US_ASCII:
+        m_fastPath = AsciiPath;
+        m_splitMode = SplitAnywhere;
+        break;
+    case UCNV_SBCS:
+        m_fastPath = SingleBytePath;
+        m_splitMode = SplitAnywhere;
+        break;
+    case UCNV_UTF16_BigEndian:
+        m_splitMode = SplitUtf16BE;
+        m_encodesAllUnicode = true;
+        break;
+    case UCNV_UTF16_LittleEndian:
+        m_splitMode = SplitUtf16LE;
+        m_encodesAllUnicode = true;
+        break;
+    case UCNV_UTF32_BigEndian:
+        m_splitMode = SplitUtf32BE;
+        m_encodesAllUnicode = true;
+        break;
+    case UCNV_UTF32_LittleEndian:
+        m_splitMode = SplitUtf32LE;
+        m_encodesAllUnicode = true;
+        break;
+    case UCNV_UTF16:
+    case UCNV_UTF32:
+    case UCNV_UTF7:
+    case UCNV_CESU8:
+    case UCNV_SCSU:
+    case UCNV_BOCU1:
+    case UCNV_IMAP_MAILBOX:
+        m_encodesAllUnicode = true;
+        break;
+    default:
+        break;
+    }
+}
+
 QString TextCodec::icuVersion()
 {
     UVersionInfo versionInfo;
@@ -70,9 +152,204 @@ QString TextCodec::icuVersion()
 
 TextCodec::~TextCodec()
 {
+    for (UConverter *converter : m_pool)
+        ucnv_close(converter);
     ucnv_close(m_converter);
 }
 
+UConverter *TextCodec::acquireConverter() const
+{
+    {
+        QMutexLocker locker(&m_poolLock);
+        if (!m_pool.empty()) {
+            UConverter *converter = m_pool.back();
+            m_pool.pop_back();
+            return converter;
+        }
+    }
+
+    // Cloning only reads from the prototype, so this doesn't need the lock
+    UErrorCode err = U_ZERO_ERROR;
+#if U_ICU_VERSION_MAJOR_NUM >= 71
+    UConverter *converter = ucnv_clone(m_converter, &err);
+#else
+    UConverter *converter = ucnv_safeClone(m_converter, nullptr, nullptr, &err);
+#endif
+    if (U_FAILURE(err)) {
+        qCDebug(CsLog, "Failed to clone UConverter for %s: %s",
+                m_name.constData(), u_errorName(err));
+    }
+    return converter;
+}
+
+void TextCodec::releaseConverter(UConverter *converter) const
+{
+    if (!converter)
+        return;
+
+    ucnv_reset(converter);
+    {
+        QMutexLocker locker(&m_poolLock);
+        if (m_pool.size() < CONVERTER_POOL_SIZE) {
+            m_pool.push_back(converter);
+            return;
+        }
+    }
+    ucnv_close(converter);
+}
+
+TextCodec::FastPath TextCodec::fastPath() const
+{
+    if (m_fastPath != SingleBytePath)
+        return m_fastPath;
+
+    std::call_once(m_singleByteOnce, [this] { buildSingleByteTable(); });
+    return m_singleByteTable ? SingleBytePath : NoFastPath;
+}
+
+// Fills in the lookup tables by running every byte and every BMP code point
+// through the converter, so they contain exactly what ICU would produce
+// (including fallback mappings and substitutions).  Any code page the
+// tables can't represent is left to ICU.
+void TextCodec::buildSingleByteTable() const
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    ConverterLease converter(this);
+    if (!converter.get())
+        return;
+
+    std::unique_ptr<TextKernels::SingleByteTable> table(new TextKernels::SingleByteTable);
+
+    char bytes[256];
+    for (int i = 0; i < 256; ++i)
+        bytes[i] = static_cast<char>(i);
+
+    // Every byte must decode to exactly one BMP code unit
+    UChar decoded[512];
+    int32_t offsets[512];
+    UChar *outptr = decoded;
+    const char *inptr = bytes;
+    UErrorCode err = U_ZERO_ERROR;
+    ucnv_toUnicode(converter.get(), &outptr, decoded + 512, &inptr, bytes + 256,
+                   offsets, true, &err);
+    if (U_FAILURE(err) || outptr - decoded != 256) {
+        qCDebug(CsLog, "Can't build a decode table for %s", m_name.constData());
+        return;
+    }
+    for (int i = 0; i < 256; ++i) {
+        if (offsets[i] != i || (decoded[i] & 0xF800) == 0xD800)
+            return;
+        table->toUnicode[i] = decoded[i];
+    }
+
+    const void *oldToUContext = Q_NULLPTR;
+    UConverterToUCallback oldToUAction;
+    err = U_ZERO_ERROR;
+    ucnv_setToUCallBack(converter.get(), UCNV_TO_U_CALLBACK_STOP, Q_NULLPTR,
+                        &oldToUAction, &oldToUContext, &err);
+    if (U_FAILURE(err))
+        return;
+    for (int i = 0; i < 256; ++i) {
+        UChar ch;
+        err = U_ZERO_ERROR;
+        ucnv_toUChars(converter.get(), &ch, 1, bytes + i, 1, &err);
+        table->invalid[i] = U_FAILURE(err);
+        ucnv_reset(converter.get());
+    }
+    err = U_ZERO_ERROR;
+    ucnv_setToUCallBack(converter.get(), oldToUAction, oldToUContext,
+                        Q_NULLPTR, Q_NULLPTR, &err);
+
+    // Encode all of the BMP at once, skipping anything unmappable.  The
+    // offsets tell us which character each output byte came from.
+    std::vector<UChar> source;
+    source.reserve(0x10000 - 0x800);
+    for (uint32_t ch = 0; ch < 0x10000; ++ch) {
+        if ((ch & 0xF800) != 0xD800)
+            source.push_back(static_cast<UChar>(ch));
+    }
+    std::vector<char> encoded(source.size());
+    std::vector<int32_t> sourceOffsets(source.size());
+
+    const void *oldFromUContext = Q_NULLPTR;
+    UConverterFromUCallback oldFromUAction;
+    err = U_ZERO_ERROR;
+    ucnv_setFromUCallBack(converter.get(), UCNV_FROM_U_CALLBACK_SKIP, Q_NULLPTR,
+                          &oldFromUAction, &oldFromUContext, &err);
+    if (U_FAILURE(err))
+        return;
+    char *encptr = encoded.data();
+    const UChar *srcptr = source.data();
+    err = U_ZERO_ERROR;
+    ucnv_fromUnicode(converter.get(), &encptr, encoded.data() + encoded.size(),
+                     &srcptr, source.data() + source.size(), sourceOffsets.data(),
+                     true, &err);
+    UErrorCode resetErr = U_ZERO_ERROR;
+    ucnv_setFromUCallBack(converter.get(), oldFromUAction, oldFromUContext,
+                          Q_NULLPTR, Q_NULLPTR, &resetErr);
+    if (U_FAILURE(err)) {
+        qCDebug(CsLog, "Can't build an encode table for %s: %s",
+                m_name.constData(), u_errorName(err));
+        return;
+    }
+
+    std::fill_n(table->pageOffset, 256, 0u);
+    table->fromUnicode.assign(256, 0);
+    bool mapsNul = false;
+    for (qsizetype i = 0; i < encptr - encoded.data(); ++i) {
+        const UChar ch = source[sourceOffsets[i]];
+        const auto byte = static_cast<unsigned char>(encoded[i]);
+        if (byte == 0) {
+            // Zero marks unmappable characters in the table
+            if (ch != 0)
+                return;
+            mapsNul = true;
+        }
+        unsigned &pageOffset = table->pageOffset[ch >> 8];
+        if (pageOffset == 0) {
+            pageOffset = static_cast<unsigned>(table->fromUnicode.size());
+            table->fromUnicode.resize(pageOffset + 256, 0);
+        }
+        table->fromUnicode[pageOffset + (ch & 0xFF)] = byte;
+    }
+    if (!mapsNul)
+        return;
+
+    // Characters outside the BMP are always treated as unmappable
+    USet *mappedSet = uset_openEmpty();
+    err = U_ZERO_ERROR;
+    ucnv_getUnicodeSet(converter.get(), mappedSet, UCNV_ROUNDTRIP_AND_FALLBACK_SET, &err);
+    const int32_t mappedCount = uset_size(mappedSet);
+    const bool mapsSupplementary = mappedCount > 0
+                                && uset_charAt(mappedSet, mappedCount - 1) > 0xFFFF;
+    uset_close(mappedSet);
+    if (U_FAILURE(err) || mapsSupplementary)
+        return;
+
+    char substitute[32];
+    int8_t substituteLength = sizeof(substitute);
+    err = U_ZERO_ERROR;
+    ucnv_getSubstChars(converter.get(), substitute, &substituteLength, &err);
+    if (U_FAILURE(err) || substituteLength != 1)
+        return;
+    table->substitute = substitute[0];
+
+    table->asciiIdentity = true;
+    for (int i = 0; i < 0x80; ++i) {
+        if (table->toUnicode[i] != i || table->invalid[i]
+                || table->fromUnicode[table->pageOffset[0] + i] != i) {
+            table->asciiIdentity = false;
+            break;
+        }
+    }
+
+    m_singleByteTable = std::move(table);
+    qCDebug(CsLog, "Built single-byte tables for %s in %lld ms",
+            m_name.constData(), timer.elapsed());
+}
+
 QByteArray TextCodec::icuName() const
 {
     UErrorCode err = U_ZERO_ERROR;
@@ -84,19 +361,67 @@ QByteArray TextCodec::icuName() const
     return name;
 }
 
+bool TextCodec::isAsciiCompatible() const
+{
+    switch (ucnv_getType(m_converter)) {
+    case UCNV_SBCS:
+    case UCNV_MBCS:
+    case UCNV_LATIN_1:
+    case UCNV_UTF8:
+    case UCNV_CESU8:
+    case UCNV_US_ASCII:
+        break;
+    default:
+        // UTF-16/32, DBCS and stateful encodings like ISO-2022 or UTF-7
+        return false;
+    }
+
+    // This rules out EBCDIC code pages, which are also SBCS or MBCS
+    ConverterLease converter(this);
+    if (!converter.get())
+        return false;
+
+    static const UChar probe[] = { '\t', '\n', '\r', ' ', '0', 'A', 'z' };
+    const int probeLength = static_cast<int>(sizeof(probe) / sizeof(probe[0]));
+    char encoded[16];
+    UErrorCode err = U_ZERO_ERROR;
+    const int length = ucnv_fromUChars(converter.get(), encoded, sizeof(encoded),
+                                       probe, probeLength, &err);
+    if (U_FAILURE(err) || length != probeLength)
+        return false;
+    for (int i = 0; i < probeLength; ++i) {
+        if (encoded[i] != static_cast<char>(probe[i]))
+            return false;
+    }
+    return true;
+}
+
 QByteArray TextCodec::fromUnicode(const QString &text, bool addHeader)
 {
     static_assert(sizeof(UChar) == sizeof(QChar),
                   "This code assumes UChar and QChar are both UTF-16 types.");
+    if (fastPath() != NoFastPath) {
+        TextEncoder encoder(this);
+        QByteArray output;
+        if (addHeader && (text.isEmpty() || text.at(0) != QChar(0xFEFF))) {
+            const QChar header(0xFEFF);
+            encoder.encode(&header, 1, output, false);
+        }
+        encoder.encode(text.constData(), text.size(), output, true);
+        return output;
+    }
+
     std::vector<UChar> buffer;
     buffer.reserve(text.size() + (addHeader ? 1 : 0));
     buffer.assign((const UChar *)text.constData(), (const UChar *)text.constData() + text.size());
     if (addHeader && (buffer.empty() || buffer.front() != 0xFEFF))
         buffer.insert(buffer.begin(), 0xFEFF);
 
-    ucnv_reset(m_converter);
+    ConverterLease converter(this);
+    if (!converter.get())
+        return QByteArray();
 
-    int maxLength = UCNV_GET_MAX_BYTES_FOR_STRING(text.length(), ucnv_getMaxCharSize(m_converter));
+    int maxLength = UCNV_GET_MAX_BYTES_FOR_STRING(text.length(), ucnv_getMaxCharSize(converter.get()));
     QByteArray output(maxLength, Qt::Uninitialized);
 
     int convBytes = 0;
@@ -105,7 +430,7 @@ QByteArray TextCodec::fromUnicode(const QString &text, bool addHeader)
     for ( ;; ) {
         char *outptr = output.data() + convBytes;
         UErrorCode err = U_ZERO_ERROR;
-        ucnv_fromUnicode(m_converter, &outptr, output.data() + output.size(),
+        ucnv_fromUnicode(converter.get(), &outptr, output.data() + output.size(),
                          &inptr, inend, nullptr, false, &err);
         if (U_FAILURE(err)) {
             qCDebug(CsLog, "ucnv_fromUnicode failed: %s", u_errorName(err));
@@ -122,57 +447,521 @@ QByteArray TextCodec::fromUnicode(const QString &text, bool addHeader)
     return output;
 }
 
+TextEncoder::TextEncoder(TextCodec *codec)
+    : m_codec(codec), m_converter(), m_fastPath(codec->fastPath()), m_pendingSurrogate()
+{
+    if (m_fastPath == TextCodec::NoFastPath)
+        m_converter = m_codec->acquireConverter();
+}
+
+TextEncoder::~TextEncoder()
+{
+    m_codec->releaseConverter(m_converter);
+}
+
+bool TextEncoder::encode(const QChar *text, qsizetype size, QByteArray &output, bool flush)
+{
+    static_assert(sizeof(UChar) == sizeof(QChar),
+                  "This code assumes UChar and QChar are both UTF-16 types.");
+    if (m_fastPath != TextCodec::NoFastPath) {
+        auto utf16 = reinterpret_cast<const char16_t *>(text);
+        const qsizetype startSize = output.size();
+        size_t length;
+        if (m_fastPath == TextCodec::Utf8Path) {
+            output.resize(startSize + (size + 1) * 3);
+            length = TextKernels::utf16ToUtf8(utf16, size, output.data() + startSize,
+                                              &m_pendingSurrogate, flush);
+        } else if (m_fastPath == TextCodec::SingleBytePath) {
+            output.resize(startSize + size + 1);
+            length = TextKernels::utf16ToSingleByte(utf16, size, output.data() + startSize,
+                                                    &m_pendingSurrogate, flush,
+                                                    *m_codec->m_singleByteTable);
+        } else {
+            output.resize(startSize + size + 1);
+            length = TextKernels::utf16ToLatin1(utf16, size, output.data() + startSize,
+                                                &m_pendingSurrogate, flush,
+                                                m_fastPath == TextCodec::AsciiPath ? 0x7F : 0xFF);
+        }
+        output.resize(startSize + static_cast<qsizetype>(length));
+        return true;
+    }
+
+    if (!m_converter)
+        return false;
+
+    const qsizetype startSize = output.size();
+    qsizetype convBytes = startSize;
+    output.resize(startSize + UCNV_GET_MAX_BYTES_FOR_STRING(size, ucnv_getMaxCharSize(m_converter)));
+
+    const UChar *inptr = reinterpret_cast<const UChar *>(text);
+    const UChar *inend = inptr + size;
+    for ( ;; ) {
+        char *outptr = output.data() + convBytes;
+        UErrorCode err = U_ZERO_ERROR;
+        ucnv_fromUnicode(m_converter, &outptr, output.data() + output.size(),
+                         &inptr, inend, nullptr, flush, &err);
+        convBytes = outptr - output.data();
+        if (err == U_BUFFER_OVERFLOW_ERROR) {
+            output.resize(output.size() * 2);
+            continue;
+        }
+        if (U_FAILURE(err)) {
+            qCDebug(CsLog, "ucnv_fromUnicode failed: %s", u_errorName(err));
+            output.resize(startSize);
+            return false;
+        }
+        break;
+    }
+
+    output.resize(convBytes);
+    return true;
+}
+
 QString TextCodec::toUnicode(const QByteArray &text)
+{
+    return toUnicode(text.constData(), text.size());
+}
+
+QString TextCodec::toUnicode(const char *data, qint64 size,
+                             const DecodeProgress &progress)
 {
     static_assert(sizeof(UChar) == sizeof(QChar),
                   "This code assumes UChar and QChar are both UTF-16 types.");
-    std::vector<UChar> buffer;
-    buffer.resize(text.size());
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    if (size > std::numeric_limits<int>::max()) {
+        qCDebug(CsLog, "Input too large to decode (%lld bytes)", size);
+        return QString();
+    }
+#endif
+
+    // Decode directly into the output string, so the caller can pass in
+    // data that was mapped from a file without making any extra copies.
+    // Most encodings never produce more UTF-16 code units than input bytes,
+    // so this usually only needs a single allocation.
+    QString output(static_cast<qsizetype>(size), Qt::Uninitialized);
+    switch (parallelToUnicode(data, size, output, progress)) {
+    case ParallelDone:
+        return output;
+    case ParallelCancelled:
+        return QString();
+    case ParallelUnsupported:
+        break;
+    }
 
-    ucnv_reset(m_converter);
+    if (fastPath() != NoFastPath)
+        return fastToUnicode(data, size, output, progress) ? output : QString();
 
-    int convChars = 0;
-    const char *inptr = text.constData();
-    const char *inend = inptr + text.length();
-    UChar *outptr = buffer.data();
+    ConverterLease converter(this);
+    if (!converter.get())
+        return QString();
+
+    qsizetype convChars = 0;
+    const char *inptr = data;
+    const char *inend = inptr + size;
     for ( ;; ) {
+        // Feed the converter in chunks so we can report progress
+        const char *chunkEnd = progress && (inend - inptr) > DECODE_CHUNK_SIZE
+                             ? inptr + DECODE_CHUNK_SIZE : inend;
+        UChar *outbuf = reinterpret_cast<UChar *>(output.data());
+        UChar *outptr = outbuf + convChars;
         UErrorCode err = U_ZERO_ERROR;
-        ucnv_toUnicode(m_converter, &outptr, buffer.data() + buffer.size(),
-                       &inptr, inend, nullptr, false, &err);
+        ucnv_toUnicode(converter.get(), &outptr, outbuf + output.size(),
+                       &inptr, chunkEnd, nullptr, false, &err);
         if (U_FAILURE(err) && err != U_BUFFER_OVERFLOW_ERROR) {
             qCDebug(CsLog, "ucnv_toUnicode failed: %s", u_errorName(err));
             return QString();
         }
 
-        convChars = outptr - buffer.data();
+        convChars = outptr - outbuf;
+        if (err == U_BUFFER_OVERFLOW_ERROR) {
+            output.resize(output.size() * 2);
+            continue;
+        }
         if (inptr >= inend)
             break;
-        buffer.resize(buffer.size() * 2);
+        if (progress && !progress(inptr - data))
+            return QString();
+    }
+
+    output.resize(convChars);
+    return output;
+}
+
+// Decodes one piece of the input with the kernel for path.  For UTF-8, an
+// incomplete sequence at the end is left unconsumed unless flush is set, so
+// this never needs more output room than the input size.  Returns the
+// number of bytes consumed.
+size_t TextCodec::fastDecode(FastPath path, const char *data, size_t size,
+                             char16_t *output, size_t *outputSize, bool flush) const
+{
+    switch (path) {
+    case Utf8Path:
+        return TextKernels::utf8ToUtf16(data, size, output, outputSize, flush);
+    case SingleBytePath:
+        TextKernels::singleByteToUtf16(data, size, output, *m_singleByteTable);
+        break;
+    default:
+        TextKernels::latin1ToUtf16(data, size, output, path == AsciiPath ? 0x7F : 0xFF);
+        break;
     }
+    *outputSize = size;
+    return size;
+}
+
+bool TextCodec::fastToUnicode(const char *data, qint64 size, QString &output,
+                              const DecodeProgress &progress)
+{
+    const FastPath path = fastPath();
+    auto outbuf = reinterpret_cast<char16_t *>(output.data());
+    qsizetype convChars = 0;
+    const char *inptr = data;
+    const char *inend = inptr + size;
+    while (inptr < inend) {
+        const char *chunkEnd = progress && (inend - inptr) > DECODE_CHUNK_SIZE
+                             ? inptr + DECODE_CHUNK_SIZE : inend;
+        size_t length;
+        inptr += fastDecode(path, inptr, chunkEnd - inptr, outbuf + convChars,
+                            &length, chunkEnd == inend);
+        convChars += static_cast<qsizetype>(length);
+        if (inptr < inend && progress && !progress(inptr - data))
+            return false;
+    }
+
+    output.resize(convChars);
+    return true;
+}
+
+namespace
+{
+    class FunctionTask : public QRunnable
+    {
+    public:
+        explicit FunctionTask(std::function<void ()> func) : m_func(std::move(func)) { }
+        void run() Q_DECL_OVERRIDE { m_func(); }
+
+    private:
+        std::function<void ()> m_func;
+    };
+
+    struct DecodeChunk
+    {
+        qint64 start, end;
+        qint64 outputStart, outputLength;
+        bool failed;
+    };
+}
 
-    return QString((const QChar *)buffer.data(), convChars);
+qint64 TextCodec::splitPoint(const char *data, qint64 offset) const
+{
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    switch (m_splitMode) {
+    case SplitUtf8:
+        // Back up to the lead byte.  If there are more than 3 continuation
+        // bytes, the one at offset can't belong to any valid sequence.
+        for (qint64 pos = offset; pos > offset - 4 && pos > 0; --pos) {
+            if ((bytes[pos] & 0xC0) != 0x80)
+                return pos;
+        }
+        return offset;
+    case SplitUtf16BE:
+    case SplitUtf16LE:
+        {
+            // Don't separate the halves of a surrogate pair
+            offset &= ~qint64(1);
+            const uchar highByte = (m_splitMode == SplitUtf16BE)
+                                 ? bytes[offset - 2] : bytes[offset - 1];
+            if ((highByte & 0xFC) == 0xD8)
+                offset -= 2;
+            return offset;
+        }
+    case SplitUtf32BE:
+    case SplitUtf32LE:
+        return offset & ~qint64(3);
+    default:
+        return offset;
+    }
+}
+
+// Number of UTF-16 code units the data decodes to.  Only needed for the
+// encodings where that isn't simply proportional to the input size.
+qint64 TextCodec::decodedLength(const char *data, qint64 size) const
+{
+    switch (m_splitMode) {
+    case SplitUtf8:
+        return static_cast<qint64>(TextKernels::utf8Utf16Length(data, size));
+    case SplitUtf16BE:
+    case SplitUtf16LE:
+        return size / 2;
+    case SplitUtf32BE:
+    case SplitUtf32LE:
+        {
+            auto bytes = reinterpret_cast<const uchar *>(data);
+            const bool bigEndian = (m_splitMode == SplitUtf32BE);
+            qint64 length = 0;
+            for (qint64 pos = 0; pos + 4 <= size; pos += 4) {
+                const uint32_t ch = bigEndian
+                        ? (uint32_t(bytes[pos]) << 24) | (uint32_t(bytes[pos + 1]) << 16)
+                          | (uint32_t(bytes[pos + 2]) << 8) | uint32_t(bytes[pos + 3])
+                        : (uint32_t(bytes[pos + 3]) << 24) | (uint32_t(bytes[pos + 2]) << 16)
+                          | (uint32_t(bytes[pos + 1]) << 8) | uint32_t(bytes[pos]);
+                length += (ch >= 0x10000 && ch <= 0x10FFFF) ? 2 : 1;
+            }
+            return length;
+        }
+    default:
+        return size;
+    }
+}
+
+// Splits the input at character boundaries and decodes the pieces on all
+// cores.  The exact output length of each piece is computed first (which is
+// trivial except for UTF-8 and UTF-32), so every piece can be decoded
+// straight into its final position in the output string.
+TextCodec::ParallelResult TextCodec::parallelToUnicode(const char *data, qint64 size,
+                                                       QString &output,
+                                                       const DecodeProgress &progress)
+{
+    if (m_splitMode == NoSplit || size < PARALLEL_DECODE_MIN_SIZE)
+        return ParallelUnsupported;
+    const int threadCount = QThread::idealThreadCount();
+    if (threadCount < 2)
+        return ParallelUnsupported;
+
+    const qint64 chunkSize = qMax<qint64>(PARALLEL_CHUNK_MIN_SIZE,
+                                          size / (threadCount * PARALLEL_CHUNKS_PER_THREAD));
+    std::vector<DecodeChunk> chunks;
+    chunks.reserve(size / chunkSize + 1);
+    qint64 start = 0;
+    while (start < size) {
+        // Avoid leaving a tiny piece at the end
+        const qint64 end = (size - start >= chunkSize + chunkSize / 2)
+                         ? splitPoint(data, start + chunkSize) : size;
+        chunks.push_back(DecodeChunk { start, end, 0, 0, false });
+        start = end;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+
+    for (auto &chunk : chunks) {
+        pool.start(new FunctionTask([this, data, &chunk] {
+            chunk.outputLength = decodedLength(data + chunk.start, chunk.end - chunk.start);
+        }));
+    }
+    pool.waitForDone();
+
+    qint64 totalLength = 0;
+    for (auto &chunk : chunks) {
+        chunk.outputStart = totalLength;
+        totalLength += chunk.outputLength;
+    }
+    if (totalLength > output.size())
+        return ParallelUnsupported;
+    output.resize(static_cast<qsizetype>(totalLength));
+    auto outbuf = reinterpret_cast<char16_t *>(output.data());
+
+    const FastPath path = fastPath();
+    std::atomic<qint64> bytesDecoded(0);
+    std::atomic<bool> cancelled(false);
+    for (auto &chunk : chunks) {
+        pool.start(new FunctionTask([this, path, data, outbuf, &chunk, &bytesDecoded, &cancelled] {
+            char16_t *outptr = outbuf + chunk.outputStart;
+            char16_t *outend = outptr + chunk.outputLength;
+            ConverterLease converter(path == NoFastPath ? this : Q_NULLPTR);
+            if (path == NoFastPath && !converter.get()) {
+                chunk.failed = true;
+                return;
+            }
+
+            // Work in smaller pieces so progress and cancellation stay responsive
+            const char *inptr = data + chunk.start;
+            const char *inend = data + chunk.end;
+            while (inptr < inend) {
+                if (cancelled.load())
+                    return;
+                const char *pieceEnd = (inend - inptr) > DECODE_CHUNK_SIZE
+                                     ? inptr + DECODE_CHUNK_SIZE : inend;
+                const char *pieceStart = inptr;
+                if (path != NoFastPath) {
+                    size_t length;
+                    inptr += fastDecode(path, inptr, pieceEnd - inptr, outptr,
+                                        &length, pieceEnd == inend);
+                    outptr += length;
+                } else {
+                    auto uoutptr = reinterpret_cast<UChar *>(outptr);
+                    UErrorCode err = U_ZERO_ERROR;
+                    ucnv_toUnicode(converter.get(), &uoutptr, reinterpret_cast<UChar *>(outend),
+                                   &inptr, pieceEnd, nullptr, false, &err);
+                    outptr = reinterpret_cast<char16_t *>(uoutptr);
+                    if (U_FAILURE(err)) {
+                        chunk.failed = true;
+                        return;
+                    }
+                }
+                bytesDecoded += inptr - pieceStart;
+            }
+            if (outptr != outend)
+                chunk.failed = true;
+        }));
+    }
+
+    while (!pool.waitForDone(PARALLEL_PROGRESS_INTERVAL)) {
+        if (progress && !cancelled.load() && !progress(bytesDecoded.load()))
+            cancelled = true;
+    }
+    if (cancelled.load())
+        return ParallelCancelled;
+
+    for (const auto &chunk : chunks) {
+        if (chunk.failed) {
+            // The length estimate didn't match what ICU produced, so
+            // just start over with a serial decode
+            qCDebug(CsLog, "Parallel decoding failed for %s", m_name.constData());
+            output.resize(static_cast<qsizetype>(size));
+            return ParallelUnsupported;
+        }
+    }
+    return ParallelDone;
 }
 
 bool TextCodec::canDecode(const QByteArray &text)
 {
-    if (text.isEmpty())
-        return true;
+    // The buffer may have been cut off in the middle of a character
+    return validate(text.constData(), text.size(), false) < 0;
+}
+
+qint64 TextCodec::validate(const char *data, qint64 size, bool complete)
+{
+    if (size <= 0)
+        return -1;
+
+    switch (fastPath()) {
+    case Utf8Path:
+        {
+            const size_t validLength = TextKernels::utf8ValidLength(data, size, complete);
+            return validLength == static_cast<size_t>(size) ? -1 : static_cast<qint64>(validLength);
+        }
+    case AsciiPath:
+        {
+            const size_t validLength = TextKernels::asciiPrefixLength(data, size);
+            return validLength == static_cast<size_t>(size) ? -1 : static_cast<qint64>(validLength);
+        }
+    case Latin1Path:
+        return -1;
+    case SingleBytePath:
+        {
+            const size_t validLength = TextKernels::singleByteValidLength(data, size,
+                                                                          *m_singleByteTable);
+            return validLength == static_cast<size_t>(size) ? -1 : static_cast<qint64>(validLength);
+        }
+    default:
+        break;
+    }
+
+    ConverterLease converter(this);
+    if (!converter.get())
+        return 0;
 
-    const void *stopContext = Q_NULLPTR;
     const void *oldContext = Q_NULLPTR;
     UConverterToUCallback oldAction;
     UErrorCode err = U_ZERO_ERROR;
-    ucnv_setToUCallBack(m_converter, UCNV_TO_U_CALLBACK_STOP, stopContext,
+    ucnv_setToUCallBack(converter.get(), UCNV_TO_U_CALLBACK_STOP, Q_NULLPTR,
                         &oldAction, &oldContext, &err);
     if (U_FAILURE(err))
         qCDebug(CsLog, "Failed to set decode callback: %s", u_errorName(err));
 
-    bool result = !toUnicode(text).isEmpty();
-    ucnv_setToUCallBack(m_converter, oldAction, oldContext, Q_NULLPTR, Q_NULLPTR, &err);
+    // The decoded text is discarded, so just keep overwriting a small
+    // scratch buffer until the input is exhausted or an error is found.
+    UChar scratch[VALIDATE_BUFFER_SIZE];
+    qint64 errorOffset = -1;
+    const char *inptr = data;
+    const char *inend = inptr + size;
+    for ( ;; ) {
+        UChar *outptr = scratch;
+        err = U_ZERO_ERROR;
+        ucnv_toUnicode(converter.get(), &outptr, scratch + VALIDATE_BUFFER_SIZE,
+                       &inptr, inend, nullptr, complete, &err);
+        if (err == U_BUFFER_OVERFLOW_ERROR)
+            continue;
+        if (U_FAILURE(err)) {
+            // The offending bytes have already been consumed from the input
+            char invalid[32];
+            int8_t invalidLength = sizeof(invalid);
+            UErrorCode invalidErr = U_ZERO_ERROR;
+            ucnv_getInvalidChars(converter.get(), invalid, &invalidLength, &invalidErr);
+            if (U_FAILURE(invalidErr))
+                invalidLength = 0;
+            errorOffset = qMax<qint64>(0, (inptr - data) - invalidLength);
+        }
+        break;
+    }
+
+    // Restore the callback before the converter goes back into the pool
+    err = U_ZERO_ERROR;
+    ucnv_setToUCallBack(converter.get(), oldAction, oldContext, Q_NULLPTR, Q_NULLPTR, &err);
     if (U_FAILURE(err))
         qCDebug(CsLog, "Failed to reset decode callback: %s", u_errorName(err));
 
-    return result;
+    return errorOffset;
+}
+
+bool TextCodec::canEncode(const QChar *text, qsizetype size)
+{
+    static_assert(sizeof(UChar) == sizeof(QChar),
+                  "This code assumes UChar and QChar are both UTF-16 types.");
+    if (size <= 0)
+        return true;
+
+    auto utf16 = reinterpret_cast<const char16_t *>(text);
+    const auto length = static_cast<size_t>(size);
+    switch (fastPath()) {
+    case Latin1Path:
+        return TextKernels::latin1EncodableLength(utf16, length, 0xFF) == length;
+    case AsciiPath:
+        return TextKernels::latin1EncodableLength(utf16, length, 0x7F) == length;
+    case SingleBytePath:
+        return TextKernels::singleByteEncodableLength(utf16, length,
+                                                      *m_singleByteTable) == length;
+    default:
+        break;
+    }
+    if (m_encodesAllUnicode)
+        return TextKernels::utf16ValidLength(utf16, length) == length;
+
+    ConverterLease converter(this);
+    if (!converter.get())
+        return false;
+
+    const void *oldContext = Q_NULLPTR;
+    UConverterFromUCallback oldAction;
+    UErrorCode err = U_ZERO_ERROR;
+    ucnv_setFromUCallBack(converter.get(), UCNV_FROM_U_CALLBACK_STOP, Q_NULLPTR,
+                          &oldAction, &oldContext, &err);
+    if (U_FAILURE(err))
+        qCDebug(CsLog, "Failed to set encode callback: %s", u_errorName(err));
+
+    // As with validate(), the output is just written to a scratch buffer
+    char scratch[VALIDATE_BUFFER_SIZE];
+    bool encodable = true;
+    const UChar *inptr = reinterpret_cast<const UChar *>(text);
+    const UChar *inend = inptr + size;
+    for ( ;; ) {
+        char *outptr = scratch;
+        err = U_ZERO_ERROR;
+        ucnv_fromUnicode(converter.get(), &outptr, scratch + VALIDATE_BUFFER_SIZE,
+                         &inptr, inend, nullptr, true, &err);
+        if (err == U_BUFFER_OVERFLOW_ERROR)
+            continue;
+        encodable = U_SUCCESS(err);
+        break;
+    }
+
+    err = U_ZERO_ERROR;
+    ucnv_setFromUCallBack(converter.get(), oldAction, oldContext, Q_NULLPTR, Q_NULLPTR, &err);
+    if (U_FAILURE(err))
+        qCDebug(CsLog, "Failed to reset encode callback: %s", u_errorName(err));
+
+    return encodable;
 }
 
 TextCodec *QTextPadCharsets::codecForName(const QByteArray &name)
@@ -362,6 +1151,7 @@ QByteArray QTextPadCharsets::getPreferredName(const QByteArray &codecName)
             qCDebug(CsLog, "Failed to get alias %u for %s: %s", (unsigned)i,
                     codecName.constData(), u_errorName(err));
         }
+        QMutexLocker locker(&s_codecs.m_lock);
         if (s_codecs.m_cache.contains(alias))
             return alias;
     }
@@ -369,3 +1159,85 @@ QByteArray QTextPadCharsets::getPreferredName(const QByteArray &codecName)
     // No match, just return what we were given
     return codecName;
 }
+
+QList<EncodingCandidate> QTextPadCharsets::detectEncoding(const char *data, qint64 size,
+                                                          std::vector<EncodingSample> *samples)
+{
+    QList<EncodingCandidate> candidates;
+    if (size <= 0)
+        return candidates;
+
+    UErrorCode err = U_ZERO_ERROR;
+    UCharsetDetector *detector = ucsdet_open(&err);
+    if (U_FAILURE(err)) {
+        qCDebug(CsLog, "Failed to create charset detector: %s", u_errorName(err));
+        return candidates;
+    }
+
+    // Ignore HTML/XML markup, which is just ASCII noise to the detector
+    ucsdet_enableInputFilter(detector, TRUE);
+
+    // Sample chunks spread evenly across the whole input, starting with a
+    // few and doubling them for as long as the detector isn't confident and
+    // we're within the time budget.  The sample size is capped, so this
+    // costs the same for a 1 MB file as for a 1 GB one.
+    const qint64 chunkSize = qMin<qint64>(size, DETECT_CHUNK_SIZE);
+    const qint64 maxChunks = qMin<qint64>(DETECT_MAX_CHUNKS, size / chunkSize);
+    QElapsedTimer timer;
+    timer.start();
+
+    QByteArray sample;
+    const UCharsetMatch **matches = Q_NULLPTR;
+    int32_t matchCount = 0;
+    for (qint64 chunks = qMin<qint64>(DETECT_FIRST_CHUNKS, maxChunks); ; chunks *= 2) {
+        chunks = qMin(chunks, maxChunks);
+        sample.clear();
+        if (samples)
+            samples->clear();
+        for (qint64 i = 0; i < chunks; ++i) {
+            const qint64 offset = (chunks > 1) ? ((size - chunkSize) * i) / (chunks - 1) : 0;
+            sample.append(data + offset, static_cast<int>(chunkSize));
+            if (samples)
+                samples->push_back(EncodingSample { offset, chunkSize });
+        }
+
+        err = U_ZERO_ERROR;
+        ucsdet_setText(detector, sample.constData(), sample.size(), &err);
+        matches = ucsdet_detectAll(detector, &matchCount, &err);
+        if (U_FAILURE(err)) {
+            qCDebug(CsLog, "Charset detection failed: %s", u_errorName(err));
+            matches = Q_NULLPTR;
+            matchCount = 0;
+            break;
+        }
+
+        if (chunks >= maxChunks || timer.elapsed() >= DETECT_TIME_BUDGET)
+            break;
+        if (matchCount > 0 && ucsdet_getConfidence(matches[0], &err) >= DETECT_CONFIDENT)
+            break;
+    }
+
+    for (int32_t i = 0; i < matchCount; ++i) {
+        err = U_ZERO_ERROR;
+        const char *name = ucsdet_getName(matches[i], &err);
+        const int32_t confidence = ucsdet_getConfidence(matches[i], &err);
+        if (U_FAILURE(err) || !name)
+            continue;
+
+        // Some results (like the directional EBCDIC variants) don't map to
+        // a converter we can use
+        if (!codecForName(name))
+            continue;
+
+        const QByteArray preferredName = getPreferredName(name);
+        auto duplicate = std::find_if(candidates.cbegin(), candidates.cend(),
+                                      [&preferredName](const EncodingCandidate &candidate) {
+            return candidate.name == preferredName;
+        });
+        if (duplicate == candidates.cend())
+            candidates.append(EncodingCandidate { preferredName, static_cast<int>(confidence) });
+    }
+
+    ucsdet_close(detector);
+    return candidates;
+}
@@ -21,32 +21,181 @@
 #include <QByteArray>
 #include <QStringList>
 #include <QCoreApplication>
+#include <QMutex>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 typedef struct UConverter UConverter;
 
+namespace TextKernels
+{
+    struct SingleByteTable;
+}
+
 class TextCodec
 {
 public:
     QByteArray name() const { return m_name; }
     QByteArray icuName() const;
 
+    // Called periodically while decoding large inputs.  Return false to
+    // abort the conversion.
+    typedef std::function<bool (qint64 bytesDecoded)> DecodeProgress;
+
     QByteArray fromUnicode(const QString &text, bool addHeader);
     QString toUnicode(const QByteArray &text);
+    QString toUnicode(const char *data, qint64 size,
+                      const DecodeProgress &progress = DecodeProgress());
     bool canDecode(const QByteArray &text);
 
+    // Checks whether the data can be decoded without errors, without
+    // building the decoded string.  Returns the offset of the first invalid
+    // byte, or -1 if the whole input is valid.  If complete is false, an
+    // incomplete character at the end of the input is not an error.
+    qint64 validate(const char *data, qint64 size, bool complete = true);
+
+    // Checks whether the text can be encoded without substituting any
+    // characters.  Unpaired surrogates can't be encoded in any encoding.
+    bool canEncode(const QChar *text, qsizetype size);
+    bool canEncode(const QString &text) { return canEncode(text.constData(), text.size()); }
+
+    // True if line breaks are always encoded as the single ASCII CR and LF
+    // bytes, and those bytes never appear as part of another character.
+    bool isAsciiCompatible() const;
+
     static TextCodec *create(const QByteArray &name);
 
     static QString icuVersion();
 
 private:
+    // Encodings that are converted with TextKernels instead of ICU
+    enum FastPath
+    {
+        NoFastPath,
+        Utf8Path,
+        Latin1Path,
+        AsciiPath,
+        SingleBytePath,
+    };
+
+    // Where the input can be split for decoding it in parallel
+    enum SplitMode
+    {
+        NoSplit,            // Multi-byte or stateful encodings
+        SplitAnywhere,      // Stateless single-byte encodings
+        SplitUtf8,
+        SplitUtf16BE,
+        SplitUtf16LE,
+        SplitUtf32BE,
+        SplitUtf32LE,
+    };
+
+    enum ParallelResult
+    {
+        ParallelDone,
+        ParallelCancelled,
+        ParallelUnsupported,
+    };
+
+    // The prototype converter is never used for conversions, since the
+    // codec may be shared by several threads.  Each conversion instead
+    // borrows a clone of it from the pool.
     UConverter *m_converter;
     QByteArray m_name;
+    FastPath m_fastPath;
+    SplitMode m_splitMode;
+    bool m_encodesAllUnicode;
 
-    TextCodec(UConverter *converter, QByteArray name)
-        : m_converter(converter), m_name(std::move(name)) { }
+    // Built from the converter the first time a single-byte codec is used
+    mutable std::once_flag m_singleByteOnce;
+    mutable std::unique_ptr<TextKernels::SingleByteTable> m_singleByteTable;
+
+    mutable QMutex m_poolLock;
+    mutable std::vector<UConverter *> m_pool;
+
+    TextCodec(UConverter *converter, QByteArray name);
     ~TextCodec();
 
+    UConverter *acquireConverter() const;
+    void releaseConverter(UConverter *converter) const;
+
+    // Holds nothing if codec is null
+    class ConverterLease
+    {
+    public:
+        explicit ConverterLease(const TextCodec *codec)
+            : m_codec(codec), m_converter(codec ? codec->acquireConverter() : nullptr) { }
+        ~ConverterLease()
+        {
+            if (m_codec)
+                m_codec->releaseConverter(m_converter);
+        }
+
+        ConverterLease(const ConverterLease &) = delete;
+        ConverterLease &operator=(const ConverterLease &) = delete;
+
+        UConverter *get() const { return m_converter; }
+
+    private:
+        const TextCodec *m_codec;
+        UConverter *m_converter;
+    };
+
+    // Returns NoFastPath if the lookup tables couldn't be built for a
+    // single-byte codec.
+    FastPath fastPath() const;
+    void buildSingleByteTable() const;
+    size_t fastDecode(FastPath path, const char *data, size_t size, char16_t *output,
+                      size_t *outputSize, bool flush) const;
+
+    bool fastToUnicode(const char *data, qint64 size, QString &output,
+                       const DecodeProgress &progress);
+    ParallelResult parallelToUnicode(const char *data, qint64 size, QString &output,
+                                     const DecodeProgress &progress);
+    qint64 splitPoint(const char *data, qint64 offset) const;
+    qint64 decodedLength(const char *data, qint64 size) const;
+
     friend struct TextCodecCache;
+    friend class TextEncoder;
+};
+
+// Incrementally encodes text in chunks, keeping conversion state (such as
+// a surrogate pair split between two chunks) across calls.  Each encoder
+// holds its own converter from the codec's pool for its whole lifetime.
+class TextEncoder
+{
+public:
+    explicit TextEncoder(TextCodec *codec);
+    ~TextEncoder();
+
+    TextEncoder(const TextEncoder &) = delete;
+    TextEncoder &operator=(const TextEncoder &) = delete;
+
+    bool isValid() const { return m_converter != nullptr || m_fastPath != TextCodec::NoFastPath; }
+
+    // Appends the encoded text to output.  Set flush on the final chunk.
+    bool encode(const QChar *text, qsizetype size, QByteArray &output, bool flush);
+
+private:
+    TextCodec *m_codec;
+    UConverter *m_converter;
+    TextCodec::FastPath m_fastPath;
+    char16_t m_pendingSurrogate;
+};
+
+struct EncodingCandidate
+{
+    QByteArray name;
+    int confidence;     // 0 to 100
+};
+
+struct EncodingSample
+{
+    qint64 offset;
+    qint64 size;
 };
 
 // Simplified version of KCharsets with more standard names and fewer duplicates
@@ -62,6 +211,13 @@ public:
 
     static QByteArray getPreferredName(const QByteArray &codecName);
 
+    // Guesses the encoding of text without a BOM from the byte statistics
+    // of chunks sampled across the whole input.  Only encodings we support
+    // are returned, most likely first.  If samples is given, it's filled in
+    // with the chunks the guesses were based on.
+    static QList<EncodingCandidate> detectEncoding(const char *data, qint64 size,
+                                                   std::vector<EncodingSample> *samples = Q_NULLPTR);
+
 private:
     QTextPadCharsets();
     static QTextPadCharsets *instance();
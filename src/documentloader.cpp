@@ -0,0 +1,135 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "documentloader.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#include "charsets.h"
+#include "rawfilecache.h"
+
+DocumentLoader::DocumentLoader(QString filename, QByteArray codecName, QObject *parent)
+    : QThread(parent), m_filename(std::move(filename)),
+      m_codecName(std::move(codecName)), m_codec(), m_cancelled()
+{
+}
+
+bool DocumentLoader::load()
+{
+    if (m_cachedModTime.isValid()) {
+        const QByteArray cached = RawFileCache::find(m_filename, m_cachedModTime);
+        if (!cached.isNull()) {
+            m_lastModified = m_cachedModTime;
+            return decode(cached.constData(), cached.size());
+        }
+    }
+
+    QFile file(m_filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = tr("Cannot open file %1 for reading").arg(m_filename);
+        return false;
+    }
+
+    // Take the timestamp before reading, so a change made while we read the
+    // file can't be hidden behind the cached copy.
+    m_lastModified = QFileInfo(file).lastModified();
+
+    // Files small enough for the cache are read into the buffer it will
+    // share, rather than mapped and then copied.
+    const qint64 fileSize = file.size();
+    if (RawFileCache::canCache(fileSize)) {
+        const QByteArray buffer = file.readAll();
+        if (!decode(buffer.constData(), buffer.size()))
+            return false;
+        RawFileCache::insert(m_filename, m_lastModified, buffer);
+        return true;
+    }
+
+    // Larger files are mapped, so we can decode straight from the file's
+    // pages without first copying the whole file into a buffer.  The
+    // mapping is dropped as soon as we're done with it, since the pages
+    // can vanish if another program truncates the file.  Some files (e.g.
+    // pipes and special devices) can't be mapped, so we still fall back to
+    // reading those.
+    uchar *mapped = (fileSize > 0) ? file.map(0, fileSize) : Q_NULLPTR;
+    if (mapped) {
+        const bool result = decode(reinterpret_cast<const char *>(mapped), fileSize);
+        file.unmap(mapped);
+        return result;
+    }
+
+    const QByteArray buffer = file.readAll();
+    if (!decode(buffer.constData(), buffer.size()))
+        return false;
+    RawFileCache::insert(m_filename, m_lastModified, buffer);
+    return true;
+}
+
+bool DocumentLoader::decode(const char *data, qint64 size)
+{
+    TextCodec *codec = Q_NULLPTR;
+    if (!m_codecName.isEmpty()) {
+        codec = QTextPadCharsets::codecForName(m_codecName);
+        if (!codec)
+            qDebug("Invalid manually-specified encoding: %s", m_codecName.constData());
+    }
+
+    // Detection covers the whole file, so we don't pick an encoding that
+    // only fits the first few KB.  There's nothing to guess if the encoding
+    // was chosen manually, but we still want the line endings.
+    if (codec)
+        m_fileType = FileTypeInfo::detectLineEndings(data, size, codec);
+    else
+        m_fileType = FileTypeInfo::detect(data, size);
+    codec = m_fileType.textCodec();
+
+    int lastPercent = -1;
+    m_document = codec->toUnicode(data, size, [&](qint64 bytesDecoded) {
+        const int percent = static_cast<int>((bytesDecoded * 100) / size);
+        if (percent != lastPercent) {
+            lastPercent = percent;
+            emit progress(percent);
+        }
+        return !isInterruptionRequested();
+    });
+
+    if (isInterruptionRequested()) {
+        m_cancelled = true;
+        m_document.clear();
+        return false;
+    }
+
+    // toUnicode() returns an empty string when the conversion fails (or the
+    // file is too large to decode).  Treating that as an empty file would
+    // let the next save wipe it out.
+    if (m_document.isEmpty() && size > m_fileType.bomOffset()) {
+        m_errorString = tr("Cannot decode file %1 as %2")
+                        .arg(m_filename, QString::fromLatin1(codec->name()));
+        return false;
+    }
+
+    if (!m_document.isEmpty() && m_document.at(0) == QChar(0xFEFF))
+        m_document.remove(0, 1);
+
+    m_codec = codec;
+    return true;
+}
+
+void DocumentLoader::run()
+{
+    (void)load();
+}
@@ -0,0 +1,78 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QTEXTPAD_DOCUMENTLOADER_H
+#define QTEXTPAD_DOCUMENTLOADER_H
+
+#include <QThread>
+#include <QDateTime>
+
+#include "filetypeinfo.h"
+
+class TextCodec;
+
+// Reads, detects and decodes a file.  This can either be run synchronously
+// with load(), or in the background with start(), in which case progress()
+// is emitted as the file is decoded and the results are available once the
+// thread has finished.
+//
+// A copy of the raw file contents is kept in RawFileCache, so a file that
+// was loaded recently can be decoded again without reading it from disk.
+class DocumentLoader : public QThread
+{
+    Q_OBJECT
+
+public:
+    DocumentLoader(QString filename, QByteArray codecName, QObject *parent = Q_NULLPTR);
+
+    // Decode the cached copy of the file if there is one from the given
+    // modification time, instead of reading the file again.
+    void setCachedModTime(const QDateTime &lastModified) { m_cachedModTime = lastModified; }
+
+    bool load();
+    void cancel() { requestInterruption(); }
+
+    QString filename() const { return m_filename; }
+    bool succeeded() const { return m_codec != Q_NULLPTR; }
+    bool wasCancelled() const { return m_cancelled; }
+    QString errorString() const { return m_errorString; }
+
+    QString takeDocument() { return std::move(m_document); }
+    const FileTypeInfo &fileType() const { return m_fileType; }
+    TextCodec *textCodec() const { return m_codec; }
+    QDateTime lastModified() const { return m_lastModified; }
+
+signals:
+    void progress(int percent);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    QString m_filename;
+    QByteArray m_codecName;
+    QString m_document;
+    FileTypeInfo m_fileType;
+    TextCodec *m_codec;
+    QDateTime m_lastModified;
+    QDateTime m_cachedModTime;
+    QString m_errorString;
+    bool m_cancelled;
+
+    bool decode(const char *data, qint64 size);
+};
+
+#endif // QTEXTPAD_DOCUMENTLOADER_H
@@ -0,0 +1,76 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "documentsaver.h"
+
+#include <QSaveFile>
+
+#include "documentwriter.h"
+#include "rawfilecache.h"
+
+DocumentSaver::DocumentSaver(QString filename, QString rawText, TextCodec *codec,
+                             FileTypeInfo::LineEndingType lineEndings, bool addBOM,
+                             QObject *parent)
+    : QThread(parent), m_filename(std::move(filename)), m_rawText(std::move(rawText)),
+      m_document(), m_codec(codec), m_lineEndings(lineEndings), m_addBOM(addBOM),
+      m_succeeded()
+{
+}
+
+DocumentSaver::DocumentSaver(QString filename, const QTextDocument *document, TextCodec *codec,
+                             FileTypeInfo::LineEndingType lineEndings, bool addBOM,
+                             QObject *parent)
+    : QThread(parent), m_filename(std::move(filename)), m_document(document),
+      m_codec(codec), m_lineEndings(lineEndings), m_addBOM(addBOM), m_succeeded()
+{
+}
+
+bool DocumentSaver::save()
+{
+    QSaveFile file(m_filename);
+    // Still allow saving files in directories we can't create files in
+    file.setDirectWriteFallback(true);
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_errorString = tr("Cannot open file %1 for writing").arg(m_filename);
+        return false;
+    }
+
+    // Even a failed save may have modified the file in place
+    RawFileCache::remove(m_filename);
+
+    DocumentWriter writer(&file, m_codec, m_lineEndings);
+    const bool written = m_document ? writer.write(m_document, m_addBOM)
+                                    : writer.write(m_rawText, m_addBOM);
+    m_rawText.clear();
+    if (!written) {
+        m_errorString = writer.errorString();
+        file.cancelWriting();
+        return false;
+    }
+
+    if (!file.commit()) {
+        m_errorString = tr("Error writing to file: %1").arg(file.errorString());
+        return false;
+    }
+
+    m_succeeded = true;
+    return true;
+}
+
+void DocumentSaver::run()
+{
+    (void)save();
+}
@@ -0,0 +1,67 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QTEXTPAD_DOCUMENTSAVER_H
+#define QTEXTPAD_DOCUMENTSAVER_H
+
+#include <QThread>
+
+#include "filetypeinfo.h"
+
+class TextCodec;
+class QTextDocument;
+
+// Encodes and writes a snapshot of the document's raw text, or the document
+// itself.  The file is written to a temporary file first and then renamed
+// over the target, so the target is never left partially written.  Like
+// DocumentLoader, this can run synchronously with save(), or in the
+// background with start() when saving a snapshot.
+class DocumentSaver : public QThread
+{
+    Q_OBJECT
+
+public:
+    DocumentSaver(QString filename, QString rawText, TextCodec *codec,
+                  FileTypeInfo::LineEndingType lineEndings, bool addBOM,
+                  QObject *parent = Q_NULLPTR);
+
+    // Writes the document directly, without taking a snapshot.  This may
+    // only be used with save() on the document's thread.
+    DocumentSaver(QString filename, const QTextDocument *document, TextCodec *codec,
+                  FileTypeInfo::LineEndingType lineEndings, bool addBOM,
+                  QObject *parent = Q_NULLPTR);
+
+    bool save();
+
+    QString filename() const { return m_filename; }
+    bool succeeded() const { return m_succeeded; }
+    QString errorString() const { return m_errorString; }
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    QString m_filename;
+    QString m_rawText;
+    const QTextDocument *m_document;
+    TextCodec *m_codec;
+    FileTypeInfo::LineEndingType m_lineEndings;
+    bool m_addBOM;
+    bool m_succeeded;
+    QString m_errorString;
+};
+
+#endif // QTEXTPAD_DOCUMENTSAVER_H
@@ -0,0 +1,141 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "documentwriter.h"
+
+#include <QIODevice>
+#include <QTextDocument>
+#include <QTextBlock>
+
+#define TEXT_CHUNK_SIZE     (16*1024)       // UTF-16 code units
+#define WRITE_CHUNK_SIZE    (64*1024)       // bytes
+
+DocumentWriter::DocumentWriter(QIODevice *device, TextCodec *codec,
+                               FileTypeInfo::LineEndingType lineEndings)
+    : m_device(device), m_encoder(codec)
+{
+    switch (lineEndings) {
+    case FileTypeInfo::CROnly:
+        m_lineEnding[0] = QLatin1Char('\r');
+        m_lineEndingSize = 1;
+        break;
+    case FileTypeInfo::LFOnly:
+        m_lineEnding[0] = QLatin1Char('\n');
+        m_lineEndingSize = 1;
+        break;
+    case FileTypeInfo::CRLF:
+        m_lineEnding[0] = QLatin1Char('\r');
+        m_lineEnding[1] = QLatin1Char('\n');
+        m_lineEndingSize = 2;
+        break;
+    }
+
+    m_text.reserve(TEXT_CHUNK_SIZE);
+    m_output.reserve(WRITE_CHUNK_SIZE * 2);
+}
+
+bool DocumentWriter::write(const QTextDocument *document, bool addBOM)
+{
+    if (!m_encoder.isValid()) {
+        m_errorString = tr("Could not create an encoder for the selected encoding");
+        return false;
+    }
+
+    if (addBOM && document->characterAt(0) != QChar(0xFEFF))
+        m_text.append(QChar(0xFEFF));
+
+    QTextBlock block = document->begin();
+    while (block.isValid()) {
+        const QString text = block.text();
+        if (!appendText(text.constData(), text.size()))
+            return false;
+        block = block.next();
+        if (block.isValid() && !appendLineEnding())
+            return false;
+    }
+
+    return flushText(true) && flushOutput();
+}
+
+bool DocumentWriter::write(const QString &rawText, bool addBOM)
+{
+    if (!m_encoder.isValid()) {
+        m_errorString = tr("Could not create an encoder for the selected encoding");
+        return false;
+    }
+
+    if (addBOM && !rawText.startsWith(QChar(0xFEFF)))
+        m_text.append(QChar(0xFEFF));
+
+    return appendText(rawText.constData(), rawText.size())
+            && flushText(true) && flushOutput();
+}
+
+bool DocumentWriter::appendText(const QChar *text, qsizetype size)
+{
+    for (qsizetype i = 0; i < size; ++i) {
+        if (m_text.size() + m_lineEndingSize > TEXT_CHUNK_SIZE && !flushText(false))
+            return false;
+
+        switch (text[i].unicode()) {
+        case 0xfdd0:    // Used internally by QTextDocument
+        case 0xfdd1:    // Used internally by QTextDocument
+        case QChar::ParagraphSeparator:
+        case QChar::LineSeparator:
+            for (int j = 0; j < m_lineEndingSize; ++j)
+                m_text.append(m_lineEnding[j]);
+            break;
+        default:
+            m_text.append(text[i]);
+            break;
+        }
+    }
+    return true;
+}
+
+bool DocumentWriter::appendLineEnding()
+{
+    const QChar separator = QChar::ParagraphSeparator;
+    return appendText(&separator, 1);
+}
+
+bool DocumentWriter::flushText(bool final)
+{
+    if (!m_encoder.encode(m_text.constData(), m_text.size(), m_output, final)) {
+        m_errorString = tr("Could not convert the document to the selected encoding");
+        return false;
+    }
+    m_text.clear();
+    return (m_output.size() < WRITE_CHUNK_SIZE) || flushOutput();
+}
+
+bool DocumentWriter::flushOutput()
+{
+    if (m_output.isEmpty())
+        return true;
+
+    qint64 count = m_device->write(m_output);
+    if (count < 0) {
+        m_errorString = tr("Error writing to file: %1").arg(m_device->errorString());
+        return false;
+    } else if (count != m_output.size()) {
+        m_errorString = tr("Error: File truncated while writing");
+        return false;
+    }
+    // Keep the reserved capacity for the next chunk
+    m_output.resize(0);
+    return true;
+}
@@ -0,0 +1,66 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QTEXTPAD_DOCUMENTWRITER_H
+#define QTEXTPAD_DOCUMENTWRITER_H
+
+#include <QCoreApplication>
+#include <QByteArray>
+#include <QVector>
+
+#include "charsets.h"
+#include "filetypeinfo.h"
+
+class QIODevice;
+class QTextDocument;
+
+// Writes a document (or a snapshot of its text) to a device in fixed-size
+// chunks, converting line endings and encoding as it goes, so the encoded
+// file is never held in memory all at once.
+class DocumentWriter
+{
+    Q_DECLARE_TR_FUNCTIONS(DocumentWriter)
+
+public:
+    DocumentWriter(QIODevice *device, TextCodec *codec,
+                   FileTypeInfo::LineEndingType lineEndings);
+
+    // Walks the document's blocks directly, so no copy of its text is made.
+    // This must be called on the document's thread.
+    bool write(const QTextDocument *document, bool addBOM);
+
+    // Writes text as returned by QTextDocument::toRawText()
+    bool write(const QString &rawText, bool addBOM);
+
+    QString errorString() const { return m_errorString; }
+
+private:
+    QIODevice *m_device;
+    TextEncoder m_encoder;
+    QChar m_lineEnding[2];
+    int m_lineEndingSize;
+
+    QVector<QChar> m_text;
+    QByteArray m_output;
+    QString m_errorString;
+
+    bool appendText(const QChar *text, qsizetype size);
+    bool appendLineEnding();
+    bool flushText(bool final);
+    bool flushOutput();
+};
+
+#endif // QTEXTPAD_DOCUMENTWRITER_H
@@ -0,0 +1,183 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "encodingtracker.h"
+
+#include <QTextDocument>
+#include <QTextBlock>
+
+#include "charsets.h"
+
+#include <algorithm>
+
+static bool isAscii(const QString &text)
+{
+    for (const QChar ch : text) {
+        if (ch.unicode() >= 0x80)
+            return false;
+    }
+    return true;
+}
+
+// Nearly every encoding can represent all of ASCII, which is what lets us
+// skip the plain ASCII blocks.  This catches the few that can't.
+static bool canEncodeAscii(TextCodec *codec)
+{
+    QString ascii(0x80, Qt::Uninitialized);
+    for (int i = 0; i < ascii.size(); ++i)
+        ascii[i] = QChar(i);
+    return codec->canEncode(ascii);
+}
+
+EncodingTracker::EncodingTracker(QTextDocument *document, QObject *parent)
+    : QObject(parent), m_document(document), m_codec(), m_checkAscii(),
+      m_unencodableBlocks()
+{
+    rescan();
+    connect(m_document, &QTextDocument::contentsChange,
+            this, &EncodingTracker::contentsChange);
+}
+
+void EncodingTracker::setCodec(TextCodec *codec)
+{
+    if (codec == m_codec)
+        return;
+
+    m_codec = codec;
+    m_checkAscii = codec && !canEncodeAscii(codec);
+    if (m_checkAscii) {
+        rescan();
+        return;
+    }
+
+    int unencodable = 0;
+    QTextBlock block = m_document->begin();
+    for (auto &state : m_blockStates) {
+        if (state != BlockAscii) {
+            state = checkBlock(block, m_codec);
+            if (state == BlockUnencodable)
+                ++unencodable;
+        }
+        block = block.next();
+    }
+    setUnencodableBlocks(unencodable);
+}
+
+int EncodingTracker::firstUnencodableBlock() const
+{
+    if (m_unencodableBlocks == 0)
+        return -1;
+
+    auto iter = std::find(m_blockStates.cbegin(), m_blockStates.cend(), BlockUnencodable);
+    return (iter != m_blockStates.cend()) ? static_cast<int>(iter - m_blockStates.cbegin()) : -1;
+}
+
+bool EncodingTracker::canEncodeWith(TextCodec *codec) const
+{
+    if (!codec)
+        return false;
+    if (codec == m_codec)
+        return canEncodeDocument();
+
+    const bool checkAscii = !canEncodeAscii(codec);
+    QTextBlock block = m_document->begin();
+    for (const auto state : m_blockStates) {
+        if ((state != BlockAscii || checkAscii) && !codec->canEncode(block.text()))
+            return false;
+        block = block.next();
+    }
+    return true;
+}
+
+// Called after every edit, with the range of the new text.  Rather than
+// trusting charsRemoved (which Qt doesn't always report accurately), the
+// number of blocks that were replaced is worked out from the change in the
+// document's block count.
+void EncodingTracker::contentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+
+    const QTextBlock first = m_document->findBlock(position);
+    QTextBlock last = m_document->findBlock(position + charsAdded);
+    if (!last.isValid())
+        last = m_document->lastBlock();
+    if (!first.isValid() || !last.isValid()) {
+        rescan();
+        return;
+    }
+
+    const int firstNumber = first.blockNumber();
+    const int newCount = last.blockNumber() - firstNumber + 1;
+    const int oldCount = newCount - (m_document->blockCount()
+                                     - static_cast<int>(m_blockStates.size()));
+    if (oldCount < 0 || firstNumber + oldCount > static_cast<int>(m_blockStates.size())) {
+        rescan();
+        return;
+    }
+
+    int unencodable = m_unencodableBlocks;
+    const auto replaced = m_blockStates.begin() + firstNumber;
+    unencodable -= static_cast<int>(std::count(replaced, replaced + oldCount, BlockUnencodable));
+    if (newCount > oldCount)
+        m_blockStates.insert(replaced + oldCount, newCount - oldCount, BlockAscii);
+    else if (newCount < oldCount)
+        m_blockStates.erase(replaced + newCount, replaced + oldCount);
+
+    QTextBlock block = first;
+    for (int i = 0; i < newCount; ++i) {
+        const BlockState state = checkBlock(block, m_codec);
+        m_blockStates[firstNumber + i] = state;
+        if (state == BlockUnencodable)
+            ++unencodable;
+        block = block.next();
+    }
+    setUnencodableBlocks(unencodable);
+}
+
+EncodingTracker::BlockState EncodingTracker::checkBlock(const QTextBlock &block,
+                                                        TextCodec *codec) const
+{
+    const QString text = block.text();
+    if (!m_checkAscii && isAscii(text))
+        return BlockAscii;
+    if (!codec || codec->canEncode(text))
+        return isAscii(text) ? BlockAscii : BlockEncodable;
+    return BlockUnencodable;
+}
+
+void EncodingTracker::setUnencodableBlocks(int count)
+{
+    const bool changed = (count == 0) != (m_unencodableBlocks == 0);
+    m_unencodableBlocks = count;
+    if (changed)
+        emit encodableChanged(count == 0);
+}
+
+void EncodingTracker::rescan()
+{
+    m_blockStates.resize(m_document->blockCount());
+
+    int unencodable = 0;
+    QTextBlock block = m_document->begin();
+    for (auto &state : m_blockStates) {
+        state = checkBlock(block, m_codec);
+        if (state == BlockUnencodable)
+            ++unencodable;
+        block = block.next();
+    }
+    setUnencodableBlocks(unencodable);
+}
@@ -0,0 +1,78 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTEXTPAD_ENCODINGTRACKER_H
+#define QTEXTPAD_ENCODINGTRACKER_H
+
+#include <QObject>
+#include <vector>
+
+class TextCodec;
+class QTextDocument;
+class QTextBlock;
+
+// Keeps track of which blocks of a document can't be represented in the
+// encoding the document will be saved in.  Only the blocks touched by each
+// edit are checked again, so the answer is available at any time without
+// encoding the whole document.
+class EncodingTracker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EncodingTracker(QTextDocument *document, QObject *parent = Q_NULLPTR);
+
+    // Rechecks every block that isn't plain ASCII
+    void setCodec(TextCodec *codec);
+    TextCodec *codec() const { return m_codec; }
+
+    bool canEncodeDocument() const { return m_unencodableBlocks == 0; }
+    int unencodableBlocks() const { return m_unencodableBlocks; }
+
+    // Block number of the first block that can't be encoded, or -1
+    int firstUnencodableBlock() const;
+
+    // Checks the document against another encoding.  Like setCodec(), this
+    // only needs to look at the blocks that aren't plain ASCII.
+    bool canEncodeWith(TextCodec *codec) const;
+
+signals:
+    void encodableChanged(bool encodable);
+
+private slots:
+    void contentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    enum BlockState : unsigned char
+    {
+        BlockAscii,
+        BlockEncodable,
+        BlockUnencodable,
+    };
+
+    QTextDocument *m_document;
+    TextCodec *m_codec;
+    bool m_checkAscii;
+    std::vector<BlockState> m_blockStates;
+    int m_unencodableBlocks;
+
+    BlockState checkBlock(const QTextBlock &block, TextCodec *codec) const;
+    void setUnencodableBlocks(int count);
+    void rescan();
+};
+
+#endif // QTEXTPAD_ENCODINGTRACKER_H
@@ -0,0 +1,372 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "filesearcher.h"
+
+#include <QDirIterator>
+#include <QFile>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <cstring>
+#include <functional>
+
+#include "charsets.h"
+#include "filetypeinfo.h"
+
+// Files are handed to the thread pool in batches, since most files in a
+// source tree take less time to search than it takes to queue them.
+#define FILES_PER_TASK          32
+
+// Searching stops after this many matches; a search that finds more than
+// this isn't going to be read through anyway.
+#define MAX_SEARCH_MATCHES      50000
+
+// Larger files are skipped.  Each file is held both as raw bytes and as
+// UTF-16 text (plus a copy of it for the search) while it's searched.
+#define MAX_SEARCH_FILE_SIZE    (Q_INT64_C(64) * 1024 * 1024)
+
+// Limits how many bytes of file data the pool threads can be reading and
+// decoding at once, so a tree full of large files doesn't multiply the
+// above by the number of threads.  Counted in KiB for QSemaphore.
+#define SEARCH_MEMORY_BUDGET_KB (256 * 1024)
+#define BUDGET_WAIT_TIMEOUT     100
+
+// Files with a NUL byte this close to the start (and no UTF-16 or UTF-32
+// BOM) are binary, and aren't worth detecting an encoding for.
+#define BINARY_CHECK_SIZE       8192
+
+// Previews of long lines are cut down to this many characters, starting
+// a little before the match.
+#define PREVIEW_LENGTH          200
+#define PREVIEW_CONTEXT         60
+
+namespace
+{
+    class FunctionTask : public QRunnable
+    {
+    public:
+        explicit FunctionTask(std::function<void ()> func) : m_func(std::move(func)) { }
+        void run() Q_DECL_OVERRIDE { m_func(); }
+
+    private:
+        std::function<void ()> m_func;
+    };
+
+    enum ReadResult
+    {
+        ReadText,
+        ReadBinary,
+        ReadFailed,
+    };
+}
+
+static QStringList splitWildcards(const QString &text)
+{
+    static const QRegularExpression s_separators(QStringLiteral("[\\s,;]+"));
+    QStringList wildcards;
+    for (const QString &wildcard : text.split(s_separators)) {
+        if (!wildcard.isEmpty())
+            wildcards.append(wildcard);
+    }
+    return wildcards;
+}
+
+static inline bool sameFileNameChar(QChar first, QChar second)
+{
+#ifdef Q_OS_WIN
+    return first.toCaseFolded() == second.toCaseFolded();
+#else
+    return first == second;
+#endif
+}
+
+// Matches the * and ? wildcards.  QDir::match() builds a regular expression
+// on every call, which adds up over a large tree.
+static bool wildcardMatch(const QString &wildcard, const QString &name)
+{
+    int pos = 0, namePos = 0;
+    int starPos = -1, starNamePos = 0;
+    while (namePos < name.size()) {
+        if (pos < wildcard.size()) {
+            const QChar ch = wildcard.at(pos);
+            if (ch == QLatin1Char('*')) {
+                starPos = pos++;
+                starNamePos = namePos;
+                continue;
+            }
+            if (ch == QLatin1Char('?') || sameFileNameChar(ch, name.at(namePos))) {
+                ++pos;
+                ++namePos;
+                continue;
+            }
+        }
+
+        // Let the last * take one more character, and try again from there
+        if (starPos < 0)
+            return false;
+        pos = starPos + 1;
+        namePos = ++starNamePos;
+    }
+    while (pos < wildcard.size() && wildcard.at(pos) == QLatin1Char('*'))
+        ++pos;
+    return pos == wildcard.size();
+}
+
+static bool wildcardMatch(const QStringList &wildcards, const QString &name)
+{
+    for (const QString &wildcard : wildcards) {
+        if (wildcardMatch(wildcard, name))
+            return true;
+    }
+    return false;
+}
+
+static bool looksBinary(const char *data, qint64 size)
+{
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    if (size >= 2 && ((bytes[0] == 0xff && bytes[1] == 0xfe)
+                      || (bytes[0] == 0xfe && bytes[1] == 0xff)))
+        return false;
+    if (size >= 4 && bytes[0] == 0 && bytes[1] == 0 && bytes[2] == 0xfe && bytes[3] == 0xff)
+        return false;
+    const size_t checkSize = static_cast<size_t>(qMin<qint64>(size, BINARY_CHECK_SIZE));
+    return std::memchr(data, 0, checkSize) != Q_NULLPTR;
+}
+
+// Reads, detects and decodes a file the same way DocumentLoader does, and
+// converts the line endings to '\n' the same way the editor would.
+// The file is read into a buffer rather than mapped, since a file that's
+// truncated while it's mapped would crash the whole search.
+static ReadResult readTextFile(QFile *file, QString *text)
+{
+    // Anything appended since the size was checked is left for next time
+    const QByteArray buffer = file->read(file->size());
+    if (file->error() != QFileDevice::NoError)
+        return ReadFailed;
+
+    const char *data = buffer.constData();
+    const qint64 dataSize = buffer.size();
+    if (looksBinary(data, dataSize))
+        return ReadBinary;
+
+    const FileTypeInfo fileType = FileTypeInfo::detect(data, dataSize);
+    if (fileType.hasNulBytes())
+        return ReadBinary;
+
+    *text = fileType.textCodec()->toUnicode(data, dataSize);
+    if (!text->isEmpty() && text->at(0) == QChar(0xFEFF))
+        text->remove(0, 1);
+    if (fileType.lineEndingCount(FileTypeInfo::CRLF) != 0)
+        text->replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    if (fileType.lineEndingCount(FileTypeInfo::CROnly) != 0)
+        text->replace(QLatin1Char('\r'), QLatin1Char('\n'));
+    text->replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+    return ReadText;
+}
+
+FileSearcher::FileSearcher(QString directory, const QString &includes,
+                           const QString &excludes,
+                           const SyntaxTextEdit::SearchParams &params, int tabWidth,
+                           QObject *parent)
+    : QThread(parent), m_directory(std::move(directory)),
+      m_includes(splitWildcards(includes)), m_excludes(splitWildcards(excludes)),
+      m_params(params), m_tabWidth(tabWidth), m_cancelled(false), m_reachedLimit(false),
+      m_filesSearched(0), m_filesSkipped(0), m_matchCount(0),
+      m_memoryBudget(SEARCH_MEMORY_BUDGET_KB)
+{
+}
+
+FileSearcher::~FileSearcher()
+{
+    cancel();
+    wait();
+}
+
+std::vector<FileSearcher::FileMatches> FileSearcher::takeResults()
+{
+    std::vector<FileMatches> results;
+    QMutexLocker locker(&m_resultsLock);
+    results.swap(m_results);
+    return results;
+}
+
+void FileSearcher::run()
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+
+    QStringList batch;
+    auto startBatch = [this, &pool, &batch] {
+        const QStringList files = batch;
+        batch.clear();
+        pool.start(new FunctionTask([this, files] {
+            for (const QString &filename : files) {
+                if (m_cancelled.load())
+                    return;
+                searchFile(filename);
+            }
+        }));
+    };
+
+    // The files are searched while we're still looking for more
+    QStringList directories { m_directory };
+    while (!directories.isEmpty() && !m_cancelled.load()) {
+        QDirIterator iter(directories.takeLast(),
+                          QDir::Dirs | QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot);
+        while (iter.hasNext()) {
+            iter.next();
+            const QFileInfo info = iter.fileInfo();
+            const QString name = info.fileName();
+            if (wildcardMatch(m_excludes, name))
+                continue;
+            if (info.isDir()) {
+                // Following links to directories could go around in circles
+                if (!info.isSymLink())
+                    directories.append(info.filePath());
+            } else if (m_includes.isEmpty() || wildcardMatch(m_includes, name)) {
+                batch.append(info.filePath());
+                if (batch.size() >= FILES_PER_TASK)
+                    startBatch();
+            }
+        }
+    }
+    if (!batch.isEmpty())
+        startBatch();
+    pool.waitForDone();
+}
+
+void FileSearcher::searchFile(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly) || file.size() > MAX_SEARCH_FILE_SIZE) {
+        m_filesSkipped += 1;
+        m_filesSearched += 1;
+        return;
+    }
+
+    // Wait for other threads to finish with enough of their files to make
+    // room for this one, but don't hold up cancelling the search.
+    const int budget = qMax(1, static_cast<int>(file.size() / 1024));
+    while (!m_memoryBudget.tryAcquire(budget, BUDGET_WAIT_TIMEOUT)) {
+        if (m_cancelled.load())
+            return;
+    }
+
+    QString text;
+    switch (readTextFile(&file, &text)) {
+    case ReadText:
+        {
+            FileMatches result;
+            result.filename = filename;
+            if (!searchText(text, &result))
+                m_filesSkipped += 1;
+            else if (!result.matches.empty())
+                addResult(std::move(result));
+        }
+        break;
+    case ReadBinary:
+        break;
+    case ReadFailed:
+        m_filesSkipped += 1;
+        break;
+    }
+
+    text.clear();
+    m_memoryBudget.release(budget);
+    m_filesSearched += 1;
+}
+
+bool FileSearcher::searchText(const QString &text, FileMatches *result)
+{
+    std::vector<SyntaxTextEdit::SearchMatch> matches;
+    if (!SyntaxTextEdit::findMatchesInText(text, m_params, &matches))
+        return false;
+
+    auto lineEndAfter = [&text](int position) {
+        const int lineEnd = text.indexOf(QLatin1Char('\n'), position);
+        return (lineEnd < 0) ? text.size() : lineEnd;
+    };
+
+    // Matches are in order, so the lines and columns can be counted as we
+    // go, rather than from the start for each match.
+    int line = 1;
+    int lineStart = 0;
+    int lineEnd = lineEndAfter(0);
+    int columnPos = 0;
+    int column = 0;
+    result->matches.reserve(matches.size());
+    for (const auto &match : matches) {
+        if (!countMatch())
+            break;
+
+        while (lineEnd < match.start) {
+            ++line;
+            lineStart = lineEnd + 1;
+            lineEnd = lineEndAfter(lineStart);
+            columnPos = lineStart;
+            column = 0;
+        }
+        for ( ; columnPos < match.start; ++columnPos) {
+            if (text.at(columnPos) == QLatin1Char('\t'))
+                column = column - (column % m_tabWidth) + m_tabWidth;
+            else
+                ++column;
+        }
+
+        int previewStart = lineStart;
+        int previewEnd = lineEnd;
+        if (previewEnd - previewStart > PREVIEW_LENGTH) {
+            previewStart = qMax(lineStart, match.start - PREVIEW_CONTEXT);
+            previewEnd = qMin(lineEnd, previewStart + PREVIEW_LENGTH);
+        }
+        const QString preview = text.mid(previewStart, previewEnd - previewStart).trimmed();
+        result->matches.push_back(Match { line, column + 1, preview });
+    }
+    return true;
+}
+
+bool FileSearcher::countMatch()
+{
+    // Other threads may be counting at the same time, but the count never
+    // goes past the limit, so it always agrees with the results.
+    int count = m_matchCount.load();
+    do {
+        if (count >= MAX_SEARCH_MATCHES) {
+            m_reachedLimit = true;
+            cancel();
+            return false;
+        }
+    } while (!m_matchCount.compare_exchange_weak(count, count + 1));
+    return true;
+}
+
+void FileSearcher::addResult(FileMatches result)
+{
+    bool wasEmpty;
+    {
+        QMutexLocker locker(&m_resultsLock);
+        wasEmpty = m_results.empty();
+        m_results.push_back(std::move(result));
+    }
+
+    // Until they're taken, the new results will be picked up with the
+    // ones that are already waiting.
+    if (wasEmpty)
+        emit resultsReady();
+}
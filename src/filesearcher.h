@@ -0,0 +1,107 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTEXTPAD_FILESEARCHER_H
+#define QTEXTPAD_FILESEARCHER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QSemaphore>
+#include <QStringList>
+
+#include <atomic>
+#include <vector>
+
+#include "syntaxtextedit.h"
+
+// Searches every file in a directory tree for Find in Files.  The tree is
+// walked on this thread, and the files themselves are read, detected and
+// searched in batches on a thread pool.  Results are collected as each file
+// is finished; resultsReady() is emitted when there are new results to take.
+//
+// Files are decoded the same way DocumentLoader would, and searched with
+// '\n' between lines, so the matches are the same as searching the file
+// once it's open.
+class FileSearcher : public QThread
+{
+    Q_OBJECT
+
+public:
+    struct Match
+    {
+        int line;           // Both 1-based, as for QTextPadWindow::gotoLine()
+        int column;
+        QString preview;    // The line (or part of it) containing the match
+    };
+
+    struct FileMatches
+    {
+        QString filename;
+        std::vector<Match> matches;
+    };
+
+    // includes and excludes are lists of wildcards separated by spaces,
+    // commas or semicolons, which are matched against file and directory
+    // names.  An empty include list matches every file.  The tab width is
+    // used to convert match positions to columns.
+    FileSearcher(QString directory, const QString &includes, const QString &excludes,
+                 const SyntaxTextEdit::SearchParams &params, int tabWidth,
+                 QObject *parent = Q_NULLPTR);
+    ~FileSearcher() Q_DECL_OVERRIDE;
+
+    void cancel() { m_cancelled = true; }
+
+    std::vector<FileMatches> takeResults();
+
+    int filesSearched() const { return m_filesSearched.load(); }
+    int matchCount() const { return m_matchCount.load(); }
+    bool reachedMatchLimit() const { return m_reachedLimit.load(); }
+
+    // Files skipped because they couldn't be read, or because the regex
+    // exceeded its match limit
+    int filesSkipped() const { return m_filesSkipped.load(); }
+
+signals:
+    void resultsReady();
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    QString m_directory;
+    QStringList m_includes;
+    QStringList m_excludes;
+    SyntaxTextEdit::SearchParams m_params;
+    int m_tabWidth;
+
+    std::atomic<bool> m_cancelled;
+    std::atomic<bool> m_reachedLimit;
+    std::atomic<int> m_filesSearched;
+    std::atomic<int> m_filesSkipped;
+    std::atomic<int> m_matchCount;
+    QSemaphore m_memoryBudget;
+
+    QMutex m_resultsLock;
+    std::vector<FileMatches> m_results;
+
+    void searchFile(const QString &filename);
+    bool searchText(const QString &text, FileMatches *result);
+    bool countMatch();
+    void addResult(FileMatches result);
+};
+
+#endif // QTEXTPAD_FILESEARCHER_H
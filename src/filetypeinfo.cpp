@@ -23,14 +23,45 @@
 
 #include "charsets.h"
 #include "syntaxtextedit.h"
+#include "textkernels.h"
 
 struct DetectionParams_p
 {
     TextCodec *textCodec;
     int bomOffset;
     FileTypeInfo::LineEndingType lineEndings;
+    TextKernels::LineStats stats;
+    QList<EncodingCandidate> encodingCandidates;
 };
 
+// Below this, ICU's detector is mostly guessing
+#define MIN_DETECT_CONFIDENCE   20
+
+// A sampled chunk can start part way through a character of up to this
+// many bytes
+#define MAX_CHARACTER_SIZE      4
+
+// Checks a guessed encoding against the chunks the detector sampled,
+// rather than the whole file.  If the guess is wrong somewhere else, the
+// file still decodes, and the user can pick another encoding.
+static bool validateSamples(TextCodec *codec, const char *data, qint64 size, bool complete,
+                            const std::vector<EncodingSample> &samples)
+{
+    if (samples.empty())
+        return codec->validate(data, size, complete) < 0;
+
+    for (const auto &sample : samples) {
+        const bool atEnd = complete && sample.offset + sample.size == size;
+        const qint64 maxSkip = (sample.offset == 0) ? 1 : qMin<qint64>(MAX_CHARACTER_SIZE, sample.size);
+        bool valid = false;
+        for (qint64 skip = 0; skip < maxSkip && !valid; ++skip)
+            valid = codec->validate(data + sample.offset + skip, sample.size - skip, atEnd) < 0;
+        if (!valid)
+            return false;
+    }
+    return true;
+}
+
 
 FileTypeInfo::~FileTypeInfo()
 {
@@ -52,7 +83,62 @@ FileTypeInfo::LineEndingType FileTypeInfo::lineEndings() const
     return reinterpret_cast<DetectionParams_p *>(m_params)->lineEndings;
 }
 
-FileTypeInfo FileTypeInfo::detect(const QByteArray &buffer)
+qint64 FileTypeInfo::lineEndingCount(LineEndingType type) const
+{
+    const auto &stats = reinterpret_cast<DetectionParams_p *>(m_params)->stats;
+    switch (type) {
+    case CROnly:
+        return static_cast<qint64>(stats.crCount);
+    case LFOnly:
+        return static_cast<qint64>(stats.lfCount);
+    case CRLF:
+        return static_cast<qint64>(stats.crlfCount);
+    }
+    return 0;
+}
+
+bool FileTypeInfo::hasMixedLineEndings() const
+{
+    const auto &stats = reinterpret_cast<DetectionParams_p *>(m_params)->stats;
+    const int kinds = (stats.crCount ? 1 : 0) + (stats.lfCount ? 1 : 0)
+                    + (stats.crlfCount ? 1 : 0);
+    return kinds > 1;
+}
+
+qint64 FileTypeInfo::lineCount() const
+{
+    const auto &stats = reinterpret_cast<DetectionParams_p *>(m_params)->stats;
+    return static_cast<qint64>(stats.crCount + stats.lfCount + stats.crlfCount) + 1;
+}
+
+qint64 FileTypeInfo::longestLine() const
+{
+    return static_cast<qint64>(reinterpret_cast<DetectionParams_p *>(m_params)->stats.longestLine);
+}
+
+bool FileTypeInfo::hasNulBytes() const
+{
+    return reinterpret_cast<DetectionParams_p *>(m_params)->stats.hasNul;
+}
+
+QList<EncodingCandidate> FileTypeInfo::encodingCandidates() const
+{
+    return reinterpret_cast<DetectionParams_p *>(m_params)->encodingCandidates;
+}
+
+FileTypeInfo FileTypeInfo::detect(const char *data, qint64 size, bool complete)
+{
+    return detectFileType(data, size, complete, Q_NULLPTR);
+}
+
+FileTypeInfo FileTypeInfo::detectLineEndings(const char *data, qint64 size, TextCodec *codec)
+{
+    Q_ASSERT(codec);
+    return detectFileType(data, size, true, codec);
+}
+
+FileTypeInfo FileTypeInfo::detectFileType(const char *data, qint64 size, bool complete,
+                                          TextCodec *knownCodec)
 {
     FileTypeInfo result;
     auto params = new DetectionParams_p;
@@ -68,52 +154,78 @@ FileTypeInfo FileTypeInfo::detect(const QByteArray &buffer)
 #else
     params->lineEndings = LFOnly;
 #endif
-    if (buffer.size() >= 3) {
-        if ((uchar)buffer.at(0) == 0xef && (uchar)buffer.at(1) == 0xbb
-                && (uchar)buffer.at(2) == 0xbf) {
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    int unitSize = 1;
+    bool bigEndian = false;
+    if (size >= 3) {
+        if (bytes[0] == 0xef && bytes[1] == 0xbb && bytes[2] == 0xbf) {
             params->textCodec = QTextPadCharsets::codecForName("UTF-8");
             params->bomOffset = 3;
         }
     }
-    if (buffer.size() >= 4 && params->textCodec == Q_NULLPTR) {
-        if ((uchar)buffer.at(0) == 0x00 && (uchar)buffer.at(1) == 0x00
-                && (uchar)buffer.at(2) == 0xfe && (uchar)buffer.at(3) == 0xff) {
+    if (size >= 4 && params->textCodec == Q_NULLPTR) {
+        if (bytes[0] == 0x00 && bytes[1] == 0x00 && bytes[2] == 0xfe && bytes[3] == 0xff) {
             params->textCodec = QTextPadCharsets::codecForName("UTF-32BE");
             params->bomOffset = 4;
-        } else if ((uchar)buffer.at(0) == 0xff && (uchar)buffer.at(1) == 0xfe
-                && (uchar)buffer.at(2) == 0x00 && (uchar)buffer.at(3) == 0x00) {
+            unitSize = 4;
+            bigEndian = true;
+        } else if (bytes[0] == 0xff && bytes[1] == 0xfe && bytes[2] == 0x00 && bytes[3] == 0x00) {
             params->textCodec = QTextPadCharsets::codecForName("UTF-32LE");
             params->bomOffset = 4;
-        } else if (buffer.at(0) == '+' && buffer.at(1) == '/' && buffer.at(2) == 'v'
-                && (buffer.at(3) == '8' || buffer.at(3) == '9' || buffer.at(3) == '+'
-                        || buffer.at(3) == '/')) {
+            unitSize = 4;
+        } else if (data[0] == '+' && data[1] == '/' && data[2] == 'v'
+                && (data[3] == '8' || data[3] == '9' || data[3] == '+' || data[3] == '/')) {
             params->textCodec = QTextPadCharsets::codecForName("UTF-7");
             params->bomOffset = 4;
         }
     }
-    if (buffer.size() >= 2 && params->textCodec == Q_NULLPTR) {
-        if ((uchar)buffer.at(0) == 0xfe && (uchar)buffer.at(1) == 0xff) {
+    if (size >= 2 && params->textCodec == Q_NULLPTR) {
+        if (bytes[0] == 0xfe && bytes[1] == 0xff) {
             params->textCodec = QTextPadCharsets::codecForName("UTF-16BE");
             params->bomOffset = 2;
-        } else if ((uchar)buffer.at(0) == 0xff && (uchar)buffer.at(1) == 0xfe) {
+            unitSize = 2;
+            bigEndian = true;
+        } else if (bytes[0] == 0xff && bytes[1] == 0xfe) {
             params->textCodec = QTextPadCharsets::codecForName("UTF-16LE");
             params->bomOffset = 2;
+            unitSize = 2;
         }
     }
 
+    // An encoding chosen by the user overrides anything we'd guess
+    if (knownCodec)
+        params->textCodec = knownCodec;
+
     // If we don't have a recognizable BOM, try seeing if the UTF-8 codec
     // can decode it without any errors
     if (params->textCodec == Q_NULLPTR) {
         auto codec = QTextPadCharsets::codecForName("UTF-8");
-        if (codec->canDecode(buffer))
+        if (codec->validate(data, size, complete) < 0)
             params->textCodec = codec;
     }
 
+    // Otherwise, guess from the byte statistics.  The detector can be fooled
+    // by short or mixed content, so only accept a candidate that can also
+    // decode the sampled text without errors.
+    std::vector<EncodingSample> samples;
+    if (params->textCodec == Q_NULLPTR) {
+        params->encodingCandidates = QTextPadCharsets::detectEncoding(data, size, &samples);
+        for (const auto &candidate : params->encodingCandidates) {
+            if (candidate.confidence < MIN_DETECT_CONFIDENCE)
+                break;
+            auto codec = QTextPadCharsets::codecForName(candidate.name);
+            if (codec && validateSamples(codec, data, size, complete, samples)) {
+                params->textCodec = codec;
+                break;
+            }
+        }
+    }
+
     // Fall back to the system locale, and after that just try ISO-8859-1
     // (Latin-1) which can decode "anything" (even if incorrectly)
     if (params->textCodec == Q_NULLPTR) {
         auto codec = QTextPadCharsets::codecForLocale();
-        if (codec->canDecode(buffer))
+        if (validateSamples(codec, data, size, complete, samples))
             params->textCodec = codec;
         else
             params->textCodec = QTextPadCharsets::codecForName("ISO-8859-1");
@@ -121,22 +233,15 @@ FileTypeInfo FileTypeInfo::detect(const QByteArray &buffer)
 
     // Now try to detect line endings.  If there are no line endings, or
     // there is no clear winner, then we stick with the platform default
-    // set above.
-    int crlfCount = 0;
-    int crCount = 0;
-    int lfCount = 0;
-    for (int i = 0; i < buffer.size(); ++i) {
-        if (buffer.at(i) == '\n') {
-            lfCount += 1;
-        } else if (buffer.at(i) == '\r') {
-            if (i + 1 < buffer.size() && buffer.at(i + 1) == '\n') {
-                crlfCount += 1;
-                ++i;
-            } else {
-                crCount += 1;
-            }
-        }
-    }
+    // set above.  This scans the whole buffer, so a file that starts with
+    // a different line ending than the rest of it is still detected by
+    // what most of the file uses.
+    auto &stats = params->stats;
+    TextKernels::scanLines(data + params->bomOffset, size - params->bomOffset,
+                           &stats, unitSize, bigEndian);
+    const size_t crlfCount = stats.crlfCount;
+    const size_t crCount = stats.crCount;
+    const size_t lfCount = stats.lfCount;
     if (lfCount > crlfCount && lfCount > crCount)
         params->lineEndings = LFOnly;
     else if (crlfCount > lfCount && crlfCount > crCount)
@@ -18,8 +18,10 @@
 #define QTEXTPAD_FILETYPEINFO_H
 
 #include <QByteArray>
+#include <QList>
 
 class TextCodec;
+struct EncodingCandidate;
 
 namespace KSyntaxHighlighting
 {
@@ -39,7 +41,21 @@ public:
     FileTypeInfo() : m_params() { }
     ~FileTypeInfo();
 
-    static FileTypeInfo detect(const QByteArray &buffer);
+    static FileTypeInfo detect(const QByteArray &buffer)
+    {
+        return detect(buffer.constData(), buffer.size());
+    }
+
+    // Validating the encoding does not allocate any memory, so this can be
+    // used on the whole file rather than just a sample from the start.
+    // If complete is false, data is only the start of the file, so a
+    // character cut off at the end isn't an error.
+    static FileTypeInfo detect(const char *data, qint64 size, bool complete = true);
+
+    // Like detect(), but uses codec rather than guessing the encoding, for
+    // when it was chosen manually.  Only the BOM and line endings are
+    // detected.
+    static FileTypeInfo detectLineEndings(const char *data, qint64 size, TextCodec *codec);
 
     FileTypeInfo(const FileTypeInfo &) = delete;
     FileTypeInfo &operator=(const FileTypeInfo &) = delete;
@@ -64,10 +80,25 @@ public:
     int bomOffset() const;
     LineEndingType lineEndings() const;
 
+    // Statistics collected over the whole detection buffer.  Line lengths
+    // are in code units of the detected encoding.
+    qint64 lineEndingCount(LineEndingType type) const;
+    bool hasMixedLineEndings() const;
+    qint64 lineCount() const;
+    qint64 longestLine() const;
+    bool hasNulBytes() const;
+
+    // Ranked guesses from the statistical detector.  This is only filled
+    // in when there was no BOM and the text wasn't valid UTF-8.
+    QList<EncodingCandidate> encodingCandidates() const;
+
     static KSyntaxHighlighting::Definition definitionForFileMagic(const QString &filename);
 
 private:
     void *m_params;
+
+    static FileTypeInfo detectFileType(const char *data, qint64 size, bool complete,
+                                       TextCodec *knownCodec);
 };
 
 #endif  // QTEXTPAD_FILETYPEINFO_H
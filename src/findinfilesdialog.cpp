@@ -0,0 +1,382 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "findinfilesdialog.h"
+
+#include <QIcon>
+#include <QLabel>
+#include <QLineEdit>
+#include <QCheckBox>
+#include <QPushButton>
+#include <QToolButton>
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QGridLayout>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QFileInfo>
+#include <QLocale>
+#include <QTimer>
+#include <QDir>
+
+#include "qtextpadwindow.h"
+#include "searchdialog.h"
+#include "filesearcher.h"
+#include "appsettings.h"
+
+// How often the status line is refreshed while a search is running
+#define STATUS_UPDATE_INTERVAL  250
+
+enum ResultRoles
+{
+    FilenameRole = Qt::UserRole,
+    LineRole,
+    ColumnRole,
+};
+
+static FindInFilesDialog *s_instance = Q_NULLPTR;
+
+FindInFilesDialog::FindInFilesDialog(QTextPadWindow *parent)
+    : QDialog(parent), m_window(parent), m_searcher(), m_fileCount()
+{
+    s_instance = this;
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    setWindowTitle(tr("Find in Files"));
+    setWindowIcon(ICON("edit-find"));
+
+    QTextPadSettings settings;
+
+    m_searchText = new SearchComboBox(this);
+    m_searchText->addItems(settings.recentSearches());
+    m_searchText->setCurrentText(QString());
+
+    m_directory = new QLineEdit(this);
+    m_directory->setText(settings.searchFilesDirectory());
+    if (m_directory->text().isEmpty()) {
+        const QString openFilename = parent->openFilename();
+        m_directory->setText(QDir::toNativeSeparators(openFilename.isEmpty()
+                                ? QDir::currentPath()
+                                : QFileInfo(openFilename).absolutePath()));
+    }
+    auto browseButton = new QToolButton(this);
+    browseButton->setIcon(ICON("document-open-folder"));
+    browseButton->setToolTip(tr("Browse..."));
+
+    m_includes = new QLineEdit(this);
+    m_includes->setText(settings.searchFilesInclude());
+    m_includes->setPlaceholderText(tr("All files"));
+    m_includes->setToolTip(tr("File name patterns to search, such as *.cpp *.h"));
+    m_excludes = new QLineEdit(this);
+    m_excludes->setText(settings.searchFilesExclude());
+    m_excludes->setToolTip(tr("File and directory name patterns to skip"));
+
+    m_caseSensitive = new QCheckBox(tr("Match ca&se"), this);
+    m_caseSensitive->setChecked(settings.searchCaseSensitive());
+    m_wholeWord = new QCheckBox(tr("Match &whole words"), this);
+    m_wholeWord->setChecked(settings.searchWholeWord());
+    m_regex = new QCheckBox(tr("Regular e&xpressions"), this);
+    m_regex->setChecked(settings.searchRegex());
+    m_escapes = new QCheckBox(tr("&Escape sequences"), this);
+    m_escapes->setChecked(settings.searchEscapes());
+
+    m_results = new QTreeWidget(this);
+    m_results->setHeaderHidden(true);
+    m_results->setUniformRowHeights(true);
+    m_results->setColumnCount(1);
+    m_results->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    m_results->header()->setStretchLastSection(false);
+
+    m_status = new QLabel(this);
+    m_statusTimer = new QTimer(this);
+    m_statusTimer->setInterval(STATUS_UPDATE_INTERVAL);
+
+    // See SearchDialog for why this isn't a QDialogButtonBox
+    auto buttonBox = new QWidget(this);
+    buttonBox->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::MinimumExpanding);
+    auto buttonLayout = new QVBoxLayout(buttonBox);
+    buttonLayout->setContentsMargins(0, 0, 0, 0);
+    buttonLayout->setSpacing(5);
+    m_findButton = new QPushButton(tr("Find &All"), this);
+    m_findButton->setDefault(true);
+    buttonLayout->addWidget(m_findButton);
+    m_stopButton = new QPushButton(tr("S&top"), this);
+    buttonLayout->addWidget(m_stopButton);
+    buttonLayout->addItem(new QSpacerItem(0, 0, QSizePolicy::Minimum, QSizePolicy::MinimumExpanding));
+    auto closeButton = new QPushButton(tr("&Close"), this);
+    buttonLayout->addWidget(closeButton);
+
+    connect(browseButton, &QToolButton::clicked, this, &FindInFilesDialog::browseDirectory);
+    connect(m_findButton, &QPushButton::clicked, this, &FindInFilesDialog::startSearch);
+    connect(m_stopButton, &QPushButton::clicked, this, &FindInFilesDialog::stopSearch);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::close);
+    connect(m_statusTimer, &QTimer::timeout, this, &FindInFilesDialog::updateStatus);
+    connect(m_results, &QTreeWidget::itemActivated, this, &FindInFilesDialog::openResult);
+
+    auto layout = new QGridLayout(this);
+    layout->setContentsMargins(10, 10, 10, 10);
+    layout->setVerticalSpacing(5);
+    layout->setHorizontalSpacing(10);
+    auto searchLabel = new QLabel(tr("&Find:"), this);
+    searchLabel->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Preferred);
+    searchLabel->setBuddy(m_searchText);
+    layout->addWidget(searchLabel, 0, 0);
+    layout->addWidget(m_searchText, 0, 1, 1, 2);
+    auto directoryLabel = new QLabel(tr("&Directory:"), this);
+    directoryLabel->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Preferred);
+    directoryLabel->setBuddy(m_directory);
+    auto directoryLayout = new QHBoxLayout;
+    directoryLayout->setContentsMargins(0, 0, 0, 0);
+    directoryLayout->setSpacing(5);
+    directoryLayout->addWidget(m_directory);
+    directoryLayout->addWidget(browseButton);
+    layout->addWidget(directoryLabel, 1, 0);
+    layout->addLayout(directoryLayout, 1, 1, 1, 2);
+    auto includeLabel = new QLabel(tr("&Include:"), this);
+    includeLabel->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Preferred);
+    includeLabel->setBuddy(m_includes);
+    layout->addWidget(includeLabel, 2, 0);
+    layout->addWidget(m_includes, 2, 1, 1, 2);
+    auto excludeLabel = new QLabel(tr("Exc&lude:"), this);
+    excludeLabel->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Preferred);
+    excludeLabel->setBuddy(m_excludes);
+    layout->addWidget(excludeLabel, 3, 0);
+    layout->addWidget(m_excludes, 3, 1, 1, 2);
+    layout->addItem(new QSpacerItem(0, 10, QSizePolicy::MinimumExpanding, QSizePolicy::Fixed),
+                    4, 0, 1, 3);
+    layout->addWidget(m_caseSensitive, 5, 1);
+    layout->addWidget(m_wholeWord, 6, 1);
+    layout->addWidget(m_regex, 5, 2);
+    layout->addWidget(m_escapes, 6, 2);
+    layout->addWidget(buttonBox, 0, 3, 7, 1);
+    layout->addWidget(m_results, 7, 0, 1, 4);
+    layout->addWidget(m_status, 8, 0, 1, 4);
+    layout->setRowStretch(7, 1);
+
+    resize(sizeHint().width() * 3 / 2, sizeHint().height() * 2);
+    updateButtons();
+}
+
+FindInFilesDialog::~FindInFilesDialog()
+{
+    // Deleting the searcher cancels it and waits for it to finish
+    delete m_searcher;
+    syncSearchSettings(false);
+    s_instance = Q_NULLPTR;
+}
+
+FindInFilesDialog *FindInFilesDialog::create(QTextPadWindow *parent)
+{
+    if (s_instance) {
+        s_instance->raise();
+    } else {
+        Q_ASSERT(parent);
+        s_instance = new FindInFilesDialog(parent);
+        s_instance->show();
+        s_instance->raise();
+        s_instance->activateWindow();
+    }
+
+    const QTextCursor cursor = parent->editor()->textCursor();
+    if (cursor.hasSelection() && !parent->isHugeFileMode())
+        s_instance->m_searchText->setCurrentText(cursor.selectedText());
+    s_instance->m_searchText->setFocus(Qt::OtherFocusReason);
+    s_instance->m_searchText->lineEdit()->selectAll();
+
+    return s_instance;
+}
+
+void FindInFilesDialog::browseDirectory()
+{
+    const QString directory = QFileDialog::getExistingDirectory(this,
+                                    tr("Search Directory"), m_directory->text());
+    if (!directory.isEmpty())
+        m_directory->setText(QDir::toNativeSeparators(directory));
+}
+
+void FindInFilesDialog::startSearch()
+{
+    const QString searchText = m_searchText->currentText();
+    if (searchText.isEmpty())
+        return;
+
+    const QString directory = QDir::fromNativeSeparators(m_directory->text());
+    if (!QFileInfo(directory).isDir()) {
+        QMessageBox::critical(this, QString(),
+                              tr("Directory %1 does not exist").arg(m_directory->text()));
+        m_directory->setFocus(Qt::OtherFocusReason);
+        return;
+    }
+
+    SyntaxTextEdit::SearchParams params;
+    params.searchText = m_escapes->isChecked()
+                      ? SearchDialog::translateEscapes(searchText)
+                      : searchText;
+    params.caseSensitive = m_caseSensitive->isChecked();
+    params.wholeWord = m_wholeWord->isChecked();
+    params.regex = m_regex->isChecked();
+
+    const QString error = SyntaxTextEdit::searchError(params);
+    if (!error.isEmpty()) {
+        QMessageBox::critical(this, QString(), tr("Invalid regular expression: %1").arg(error));
+        m_searchText->setFocus(Qt::OtherFocusReason);
+        return;
+    }
+
+    syncSearchSettings(true);
+
+    // Throw away any search that's still running; its results would be
+    // mixed in with the new ones otherwise.
+    delete m_searcher;
+    m_results->clear();
+    m_fileCount = 0;
+
+    m_searchRoot = QDir(directory).absolutePath();
+    m_searcher = new FileSearcher(m_searchRoot, m_includes->text(), m_excludes->text(),
+                                  params, m_window->editor()->tabWidth(), this);
+    connect(m_searcher, &FileSearcher::resultsReady, this, &FindInFilesDialog::takeResults);
+    connect(m_searcher, &QThread::finished, this, &FindInFilesDialog::searchFinished);
+    m_elapsed.start();
+    m_searcher->start();
+    m_statusTimer->start();
+
+    updateStatus();
+    updateButtons();
+}
+
+void FindInFilesDialog::stopSearch()
+{
+    // The results found so far are kept; searchFinished() will clean up
+    // once the workers have stopped.
+    if (m_searcher)
+        m_searcher->cancel();
+}
+
+void FindInFilesDialog::takeResults()
+{
+    if (!m_searcher)
+        return;
+
+    const QDir root(m_searchRoot);
+    for (auto &file : m_searcher->takeResults()) {
+        auto fileItem = new QTreeWidgetItem(m_results);
+        const QString relativeName = QDir::toNativeSeparators(root.relativeFilePath(file.filename));
+        fileItem->setText(0, tr("%1 (%2)").arg(relativeName, QString::number(file.matches.size())));
+        fileItem->setData(0, FilenameRole, file.filename);
+
+        QList<QTreeWidgetItem *> matchItems;
+        matchItems.reserve(static_cast<int>(file.matches.size()));
+        for (const auto &match : file.matches) {
+            auto item = new QTreeWidgetItem;
+            item->setText(0, tr("%1: %2").arg(QString::number(match.line), match.preview));
+            item->setData(0, FilenameRole, file.filename);
+            item->setData(0, LineRole, match.line);
+            item->setData(0, ColumnRole, match.column);
+            matchItems.append(item);
+        }
+        fileItem->addChildren(matchItems);
+        fileItem->setExpanded(true);
+        ++m_fileCount;
+    }
+}
+
+void FindInFilesDialog::searchFinished()
+{
+    if (!m_searcher || sender() != m_searcher)
+        return;
+
+    takeResults();
+    m_statusTimer->stop();
+    updateStatus();
+
+    m_searcher->deleteLater();
+    m_searcher = Q_NULLPTR;
+    updateButtons();
+}
+
+void FindInFilesDialog::updateStatus()
+{
+    if (!m_searcher)
+        return;
+
+    const QLocale locale;
+    const QString seconds = locale.toString(m_elapsed.elapsed() / 1000.0, 'f', 1);
+    QString status;
+    if (m_searcher->isFinished()) {
+        status = tr("%1 matches in %2 files (searched %3 files in %4 seconds)")
+                    .arg(locale.toString(m_searcher->matchCount()),
+                         locale.toString(m_fileCount),
+                         locale.toString(m_searcher->filesSearched()), seconds);
+    } else {
+        status = tr("Searching... %1 matches (searched %2 files in %3 seconds)")
+                    .arg(locale.toString(m_searcher->matchCount()),
+                         locale.toString(m_searcher->filesSearched()), seconds);
+    }
+    if (m_searcher->reachedMatchLimit())
+        status += QLatin1Char(' ') + tr("Stopped at the match limit.");
+    if (m_searcher->filesSkipped() > 0) {
+        status += QLatin1Char(' ') + tr("%1 files could not be searched.")
+                    .arg(locale.toString(m_searcher->filesSkipped()));
+    }
+    m_status->setText(status);
+}
+
+void FindInFilesDialog::openResult(QTreeWidgetItem *item)
+{
+    const QString filename = item->data(0, FilenameRole).toString();
+    const int line = item->data(0, LineRole).toInt();
+    const int column = item->data(0, ColumnRole).toInt();
+
+    if (QFileInfo(m_window->openFilename()) != QFileInfo(filename)) {
+        if (!m_window->promptForSave())
+            return;
+        if (!m_window->loadDocumentFrom(filename))
+            return;
+    }
+
+    // File items have no line; those just open the file.
+    if (line > 0)
+        m_window->gotoLine(line, column);
+}
+
+void FindInFilesDialog::syncSearchSettings(bool saveRecent)
+{
+    QTextPadSettings settings;
+
+    const QString searchText = m_searchText->currentText();
+    if (!searchText.isEmpty() && saveRecent) {
+        if (m_searchText->count() == 0 || m_searchText->itemText(0) != searchText) {
+            settings.addRecentSearch(searchText);
+            m_searchText->insertItem(0, searchText);
+        }
+    }
+
+    settings.setSearchFilesDirectory(m_directory->text());
+    settings.setSearchFilesInclude(m_includes->text());
+    settings.setSearchFilesExclude(m_excludes->text());
+    settings.setSearchCaseSensitive(m_caseSensitive->isChecked());
+    settings.setSearchWholeWord(m_wholeWord->isChecked());
+    settings.setSearchRegex(m_regex->isChecked());
+    settings.setSearchEscapes(m_escapes->isChecked());
+}
+
+void FindInFilesDialog::updateButtons()
+{
+    m_findButton->setEnabled(!m_searcher);
+    m_stopButton->setEnabled(m_searcher != Q_NULLPTR);
+}
@@ -0,0 +1,79 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QTEXTPAD_FINDINFILESDIALOG_H
+#define QTEXTPAD_FINDINFILESDIALOG_H
+
+#include <QDialog>
+#include <QElapsedTimer>
+
+class QLabel;
+class QLineEdit;
+class QCheckBox;
+class QPushButton;
+class QTreeWidget;
+class QTreeWidgetItem;
+class QTimer;
+class SearchComboBox;
+class FileSearcher;
+class QTextPadWindow;
+
+class FindInFilesDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    static FindInFilesDialog *create(QTextPadWindow *parent);
+
+    ~FindInFilesDialog() Q_DECL_OVERRIDE;
+
+private slots:
+    void browseDirectory();
+    void startSearch();
+    void stopSearch();
+    void takeResults();
+    void searchFinished();
+    void updateStatus();
+    void openResult(QTreeWidgetItem *item);
+
+private:
+    explicit FindInFilesDialog(QTextPadWindow *parent);
+
+    void syncSearchSettings(bool saveRecent);
+    void updateButtons();
+
+    SearchComboBox *m_searchText;
+    QLineEdit *m_directory;
+    QLineEdit *m_includes;
+    QLineEdit *m_excludes;
+    QCheckBox *m_caseSensitive;
+    QCheckBox *m_wholeWord;
+    QCheckBox *m_regex;
+    QCheckBox *m_escapes;
+    QPushButton *m_findButton;
+    QPushButton *m_stopButton;
+    QTreeWidget *m_results;
+    QLabel *m_status;
+    QTimer *m_statusTimer;
+
+    QTextPadWindow *m_window;
+    FileSearcher *m_searcher;
+    QString m_searchRoot;
+    QElapsedTimer m_elapsed;
+    int m_fileCount;
+};
+
+#endif // QTEXTPAD_FINDINFILESDIALOG_H
@@ -0,0 +1,966 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hugefileview.h"
+
+#include <QScrollBar>
+#include <QPainter>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QClipboard>
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QProgressDialog>
+#include <QtMath>
+#include <KSyntaxHighlighting/Theme>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "charsets.h"
+
+#define DETECTION_SIZE      (      4*1024)
+#define LINE_INDEX_STRIDE   1024
+#define INDEX_CHUNK_SIZE    (   1024*1024)
+#define INDEX_TIME_SLICE    15              // ms
+#define SEARCH_CHUNK_SIZE   (4*1024*1024)
+
+// Indexing more than this much of the file at once shows a progress dialog,
+// so the user can cancel instead of waiting for the whole file.
+#define INDEX_PROGRESS_SIZE (64*1024*1024)
+
+// Lines longer than this are truncated for display.  They are still
+// searched in full.
+#define MAX_LINE_BYTES      (  64*1024)
+
+// Search chunks are normally extended to the end of a line, but a line that
+// would take more than another SEARCH_CHUNK_SIZE is split instead.  The
+// pieces overlap by this much, so only matches longer than this can be
+// missed where a line is split.  Split points are looked for within
+// SPLIT_SEARCH_SIZE bytes, so a character is never cut in two.
+#define SEARCH_OVERLAP      (  64*1024)
+#define SPLIT_SEARCH_SIZE   1024
+
+// Matches QTextDocument's default document margin
+#define DOCUMENT_MARGIN     4
+
+static inline int clampIndex(qint64 index)
+{
+    return static_cast<int>(qMin<qint64>(index, std::numeric_limits<int>::max()));
+}
+
+static inline qreal textWidth(const QFontMetricsF &metrics, const QString &text)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 11, 0))
+    return metrics.horizontalAdvance(text);
+#else
+    return metrics.width(text);
+#endif
+}
+
+HugeFileView::HugeFileView(QWidget *parent)
+    : QAbstractScrollArea(parent), m_openCount(), m_data(), m_size(), m_dataStart(), m_codec(),
+      m_lineEndings(FileTypeInfo::LFOnly), m_lineBreak('\n'), m_lineCount(),
+      m_indexedTo(), m_cursorLine(), m_cursorIndex(), m_matchLength(),
+      m_maxLineWidth(), m_showLineNumbers(), m_tabCharSize(4)
+{
+    m_lineMargin = new LineMargin(this);
+    m_indexTimer = new QTimer(this);
+    m_indexTimer->setInterval(0);
+    connect(m_indexTimer, &QTimer::timeout, this, &HugeFileView::indexNextChunk);
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, [this](const QString &) {
+        (void)checkFileSize();
+    });
+
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setCursor(Qt::IBeamCursor);
+    verticalScrollBar()->setSingleStep(1);
+}
+
+HugeFileView::~HugeFileView()
+{
+    closeFile();
+}
+
+bool HugeFileView::canDisplay(TextCodec *codec)
+{
+    // We find line breaks by scanning for the raw CR/LF bytes, and decode
+    // each line independently.
+    return codec && codec->isAsciiCompatible();
+}
+
+bool HugeFileView::openFile(const QString &filename, TextCodec *codec)
+{
+    closeFile();
+
+    m_file.setFileName(filename);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = tr("Cannot open file %1 for reading").arg(filename);
+        return false;
+    }
+
+    m_size = m_file.size();
+    uchar *mapped = (m_size > 0) ? m_file.map(0, m_size) : Q_NULLPTR;
+    if (!mapped) {
+        m_errorString = tr("Cannot map file %1 into memory").arg(filename);
+        m_file.close();
+        m_size = 0;
+        return false;
+    }
+    m_data = reinterpret_cast<const char *>(mapped);
+    m_watcher->addPath(filename);
+
+    // Validating the whole file would stall the UI, so only check a sample
+    auto detect = FileTypeInfo::detect(m_data, qMin<qint64>(m_size, DETECTION_SIZE),
+                                       m_size <= DETECTION_SIZE);
+    if (!codec)
+        codec = detect.textCodec();
+    if (!canDisplay(codec)) {
+        m_errorString = tr("The %1 encoding is not supported by the large file viewer.")
+                        .arg(QString::fromLatin1(codec->name()));
+        closeFile();
+        return false;
+    }
+
+    m_codec = codec;
+    m_lineEndings = detect.lineEndings();
+    m_lineBreak = (m_lineEndings == FileTypeInfo::CROnly) ? '\r' : '\n';
+    m_dataStart = (codec == detect.textCodec()) ? detect.bomOffset() : 0;
+
+    m_lineIndex.clear();
+    m_lineIndex.append(m_dataStart);
+    m_lineCount = 1;
+    m_indexedTo = m_dataStart;
+    m_cursorLine = 0;
+    m_cursorIndex = 0;
+    m_matchLength = 0;
+    m_maxLineWidth = 0;
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+
+    // Index the first slice right away so we can show the first page
+    indexSlice();
+    if (isIndexing())
+        m_indexTimer->start();
+
+    updateMargins();
+    updateScrollBars();
+    viewport()->update();
+    emit cursorPositionChanged();
+    return true;
+}
+
+void HugeFileView::closeFile()
+{
+    m_indexTimer->stop();
+    if (!m_watcher->files().isEmpty())
+        m_watcher->removePaths(m_watcher->files());
+    ++m_openCount;
+    if (m_data) {
+        m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_data)));
+        m_data = Q_NULLPTR;
+    }
+    m_file.close();
+    m_size = 0;
+    m_dataStart = 0;
+    m_lineIndex.clear();
+    m_lineIndex.squeeze();
+    m_lineCount = 0;
+    m_indexedTo = 0;
+    m_cursorLine = 0;
+    m_cursorIndex = 0;
+    m_matchLength = 0;
+    viewport()->update();
+}
+
+bool HugeFileView::isIndexing() const
+{
+    return m_data && m_indexedTo < m_size;
+}
+
+bool HugeFileView::checkFileSize()
+{
+    if (!m_data)
+        return false;
+
+    // QFile::size() stats the open file again, so this also catches the
+    // file being truncated in place (e.g. by logrotate's copytruncate).
+    if (m_file.size() >= m_size)
+        return true;
+
+    reopenFile();
+    return false;
+}
+
+void HugeFileView::reopenFile()
+{
+    const QString filename = m_file.fileName();
+    const qint64 cursorLine = m_cursorLine;
+    if (!openFile(filename, m_codec)) {
+        qDebug("Could not reopen %s: %s", qPrintable(filename), qPrintable(m_errorString));
+        return;
+    }
+    setCursorPosition(qMin(cursorLine, m_lineCount - 1), 0);
+}
+
+void HugeFileView::indexNextChunk()
+{
+    if (checkFileSize())
+        indexSlice();
+}
+
+void HugeFileView::indexSlice()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const qint64 oldLineCount = m_lineCount;
+    while (m_indexedTo < m_size) {
+        const char *ptr = m_data + m_indexedTo;
+        const char *end = m_data + qMin<qint64>(m_indexedTo + INDEX_CHUNK_SIZE, m_size);
+        while (ptr < end) {
+            auto lineBreak = static_cast<const char *>(std::memchr(ptr, m_lineBreak, end - ptr));
+            if (!lineBreak)
+                break;
+            ptr = lineBreak + 1;
+            if ((m_lineCount % LINE_INDEX_STRIDE) == 0)
+                m_lineIndex.append(ptr - m_data);
+            ++m_lineCount;
+        }
+        m_indexedTo = end - m_data;
+        if (timer.elapsed() >= INDEX_TIME_SLICE)
+            break;
+    }
+
+    if (!isIndexing())
+        m_indexTimer->stop();
+    if (m_lineCount != oldLineCount) {
+        updateMargins();
+        updateScrollBars();
+        m_lineMargin->update();
+    }
+}
+
+bool HugeFileView::indexUntil(qint64 offset, qint64 lineCount)
+{
+    auto done = [this, offset, lineCount] {
+        return !isIndexing() || m_indexedTo >= offset || m_lineCount >= lineCount;
+    };
+    if (!checkFileSize())
+        return false;
+    if (done())
+        return true;
+
+    if (qMin(offset, m_size) - m_indexedTo <= INDEX_PROGRESS_SIZE) {
+        while (!done()) {
+            if (!checkFileSize())
+                return false;
+            indexSlice();
+        }
+        return true;
+    }
+
+    // The file may be reopened while the progress dialog processes events,
+    // after which any offsets the caller has are no longer valid.
+    const quint64 openCount = m_openCount;
+
+    QProgressDialog progress(tr("Counting lines..."), tr("Cancel"), 0, 100, this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+    while (!done()) {
+        if (!checkFileSize())
+            return false;
+        indexSlice();
+        // Modal progress dialogs process events in setValue()
+        progress.setValue(static_cast<int>((m_indexedTo * 100) / m_size));
+        if (progress.wasCanceled() || m_openCount != openCount)
+            return false;
+    }
+    return m_data != Q_NULLPTR && m_openCount == openCount;
+}
+
+qint64 HugeFileView::lineStart(qint64 line) const
+{
+    Q_ASSERT(line >= 0 && line < m_lineCount);
+    qint64 offset = m_lineIndex.at(static_cast<int>(line / LINE_INDEX_STRIDE));
+    for (qint64 skip = line % LINE_INDEX_STRIDE; skip > 0; --skip) {
+        auto lineBreak = static_cast<const char *>(std::memchr(m_data + offset, m_lineBreak,
+                                                               m_size - offset));
+        Q_ASSERT(lineBreak);
+        offset = lineBreak - m_data + 1;
+    }
+    return offset;
+}
+
+qint64 HugeFileView::lineEnd(qint64 start) const
+{
+    auto lineBreak = static_cast<const char *>(std::memchr(m_data + start, m_lineBreak,
+                                                           m_size - start));
+    return lineBreak ? lineBreak - m_data : m_size;
+}
+
+qint64 HugeFileView::findLineStart(qint64 offset, qint64 minOffset) const
+{
+    for (qint64 pos = offset; pos > qMax(m_dataStart, minOffset); --pos) {
+        if (m_data[pos - 1] == m_lineBreak)
+            return pos;
+    }
+    return (minOffset > m_dataStart) ? -1 : m_dataStart;
+}
+
+qint64 HugeFileView::splitPoint(qint64 offset) const
+{
+    // ASCII controls, spaces and the punctuation below '0' are never part
+    // of a multi-byte character in the encodings we can display
+    const qint64 minOffset = qMax(m_dataStart, offset - SPLIT_SEARCH_SIZE);
+    for (qint64 pos = offset; pos > minOffset; --pos) {
+        if (static_cast<uchar>(m_data[pos - 1]) < 0x30)
+            return pos;
+    }
+
+    // Otherwise, at least don't split a UTF-8 sequence
+    qint64 pos = offset;
+    while (pos > minOffset && pos > offset - 3
+           && (static_cast<uchar>(m_data[pos]) & 0xC0) == 0x80)
+        --pos;
+    return pos;
+}
+
+qint64 HugeFileView::columnAt(qint64 offset) const
+{
+    qint64 column = 0;
+    qint64 pos = findLineStart(offset);
+    while (pos < offset) {
+        const qint64 end = (offset - pos > SEARCH_CHUNK_SIZE)
+                         ? splitPoint(pos + SEARCH_CHUNK_SIZE) : offset;
+        column += m_codec->toUnicode(m_data + pos, end - pos).size();
+        pos = end;
+    }
+    return column;
+}
+
+QString HugeFileView::decodeRange(qint64 start, qint64 split, qint64 end, int *splitIndex) const
+{
+    QString text = m_codec->toUnicode(m_data + start, split - start);
+    *splitIndex = text.size();
+    if (split < end)
+        text += m_codec->toUnicode(m_data + split, end - split);
+    return text;
+}
+
+QString HugeFileView::decodeLine(qint64 start, qint64 end) const
+{
+    if (m_lineBreak == '\n' && end > start && m_data[end - 1] == '\r')
+        --end;
+    if (end - start > MAX_LINE_BYTES)
+        end = start + MAX_LINE_BYTES;
+    return m_codec->toUnicode(m_data + start, end - start);
+}
+
+QString HugeFileView::lineText(qint64 line) const
+{
+    const qint64 start = lineStart(line);
+    return decodeLine(start, lineEnd(start));
+}
+
+QString HugeFileView::expandTabs(const QString &text, QVector<int> *indexMap) const
+{
+    QString result;
+    result.reserve(text.size());
+    if (indexMap)
+        indexMap->resize(text.size() + 1);
+    for (int i = 0; i < text.size(); ++i) {
+        if (indexMap)
+            (*indexMap)[i] = result.size();
+        const QChar ch = text.at(i);
+        if (ch == QLatin1Char('\t')) {
+            const int spaces = m_tabCharSize - (result.size() % m_tabCharSize);
+            result.append(QString(spaces, QLatin1Char(' ')));
+        } else {
+            result.append(ch);
+        }
+    }
+    if (indexMap)
+        (*indexMap)[text.size()] = result.size();
+    return result;
+}
+
+qreal HugeFileView::textX(const QString &text, int index) const
+{
+    return textWidth(QFontMetricsF(font()), text.left(index));
+}
+
+int HugeFileView::indexAt(const QString &text, qreal x) const
+{
+    QVector<int> indexMap;
+    const QString display = expandTabs(text, &indexMap);
+    for (int i = 0; i < text.size(); ++i) {
+        const qreal left = textX(display, indexMap.at(i));
+        const qreal right = textX(display, indexMap.at(i + 1));
+        if (x < (left + right) / 2)
+            return i;
+    }
+    return text.size();
+}
+
+int HugeFileView::cursorColumn() const
+{
+    if (!m_data)
+        return 0;
+    const QString text = lineText(m_cursorLine);
+    QVector<int> indexMap;
+    (void)expandTabs(text, &indexMap);
+    return indexMap.at(qMin(m_cursorIndex, text.size()));
+}
+
+void HugeFileView::moveCursorTo(qint64 line, int column)
+{
+    if (!checkFileSize())
+        return;
+    if (line > m_lineCount && !indexUntil(m_size, line))
+        return;
+
+    if (line > m_lineCount) {
+        // Just navigate to the end of the file if we don't have the requested
+        // line number.
+        const QString lastLine = lineText(m_lineCount - 1);
+        setCursorPosition(m_lineCount - 1, lastLine.size());
+        return;
+    }
+
+    const qint64 target = qMax<qint64>(0, line - 1);
+    int cursorIndex = 0;
+    if (column > 0) {
+        const QString text = lineText(target);
+        int columnIndex = 0;
+        for (; cursorIndex < text.size(); ++cursorIndex) {
+            if (columnIndex >= column - 1)
+                break;
+            if (text.at(cursorIndex) == QLatin1Char('\t'))
+                columnIndex = columnIndex - (columnIndex % m_tabCharSize) + m_tabCharSize;
+            else
+                ++columnIndex;
+        }
+    }
+    setCursorPosition(target, cursorIndex);
+}
+
+void HugeFileView::setCursorPosition(qint64 line, int index, int matchLength)
+{
+    m_cursorLine = qBound<qint64>(0, line, qMax<qint64>(0, m_lineCount - 1));
+    m_cursorIndex = qMax(0, index);
+    m_matchLength = matchLength;
+    ensureCursorVisible();
+    viewport()->update();
+    m_lineMargin->update();
+    emit cursorPositionChanged();
+}
+
+qint64 HugeFileView::topLine() const
+{
+    return verticalScrollBar()->value();
+}
+
+int HugeFileView::visibleLines() const
+{
+    return qMax(1, viewport()->height() / fontMetrics().height());
+}
+
+void HugeFileView::ensureCursorVisible()
+{
+    const qint64 top = topLine();
+    const int page = visibleLines();
+    if (m_cursorLine < top)
+        verticalScrollBar()->setValue(static_cast<int>(m_cursorLine));
+    else if (m_cursorLine >= top + page)
+        verticalScrollBar()->setValue(static_cast<int>(m_cursorLine - page + 1));
+
+    const QString display = expandTabs(lineText(m_cursorLine).left(m_cursorIndex + m_matchLength));
+    const QString prefix = expandTabs(lineText(m_cursorLine).left(m_cursorIndex));
+    const int left = qFloor(textWidth(QFontMetricsF(font()), prefix));
+    const int right = qCeil(textWidth(QFontMetricsF(font()), display)) + 2 * DOCUMENT_MARGIN;
+    const int scrollX = horizontalScrollBar()->value();
+    if (right > m_maxLineWidth) {
+        m_maxLineWidth = right;
+        updateScrollBars();
+    }
+    if (left < scrollX)
+        horizontalScrollBar()->setValue(left);
+    else if (right > scrollX + viewport()->width())
+        horizontalScrollBar()->setValue(right - viewport()->width());
+}
+
+void HugeFileView::updateScrollBars()
+{
+    // Line numbers past INT_MAX can't be reached with the scroll bar, but
+    // such files would need more than 2 GiB of line breaks alone.
+    const int page = visibleLines();
+    const qint64 maxTop = qMax<qint64>(0, m_lineCount - page);
+    verticalScrollBar()->setRange(0, static_cast<int>(qMin<qint64>(maxTop,
+                                                      std::numeric_limits<int>::max())));
+    verticalScrollBar()->setPageStep(page);
+
+    const int width = viewport()->width();
+    horizontalScrollBar()->setRange(0, qMax(0, m_maxLineWidth - width));
+    horizontalScrollBar()->setPageStep(width);
+    horizontalScrollBar()->setSingleStep(fontMetrics().averageCharWidth());
+}
+
+int HugeFileView::lineMarginWidth()
+{
+    if (!m_showLineNumbers)
+        return 0;
+
+    int digits = 1;
+    qint64 maxLine = qMax<qint64>(1, m_lineCount);
+    while (maxLine >= 10) {
+        maxLine /= 10;
+        ++digits;
+    }
+    const QFontMetricsF metrics(font());
+    return qCeil(metrics.boundingRect(QString(digits + 1, QLatin1Char('0'))).width() + qreal(2.0));
+}
+
+void HugeFileView::updateMargins()
+{
+    const int marginWidth = lineMarginWidth();
+    setViewportMargins(marginWidth, 0, 0, 0);
+    const QRect cr = contentsRect();
+    m_lineMargin->setGeometry(cr.left(), cr.top(), marginWidth, cr.height());
+    m_lineMargin->setVisible(m_showLineNumbers);
+}
+
+void HugeFileView::setShowLineNumbers(bool show)
+{
+    m_showLineNumbers = show;
+    updateMargins();
+}
+
+void HugeFileView::setTabWidth(int width)
+{
+    m_tabCharSize = qMax(1, width);
+    viewport()->update();
+}
+
+void HugeFileView::setTheme(const KSyntaxHighlighting::Theme &theme)
+{
+    QPalette pal = palette();
+    pal.setColor(QPalette::Text, theme.textColor(KSyntaxHighlighting::Theme::Normal));
+    pal.setColor(QPalette::Base, theme.editorColor(KSyntaxHighlighting::Theme::BackgroundColor));
+    pal.setColor(QPalette::Highlight, theme.editorColor(KSyntaxHighlighting::Theme::TextSelection));
+    setPalette(pal);
+
+    m_lineMarginFg = theme.editorColor(KSyntaxHighlighting::Theme::LineNumbers);
+    m_lineMarginBg = theme.editorColor(KSyntaxHighlighting::Theme::IconBorder);
+    m_cursorLineBg = theme.editorColor(KSyntaxHighlighting::Theme::CurrentLine);
+    m_cursorLineNum = theme.editorColor(KSyntaxHighlighting::Theme::CurrentLineNumber);
+    m_searchBg = theme.editorColor(KSyntaxHighlighting::Theme::SearchHighlight);
+
+    viewport()->update();
+    m_lineMargin->update();
+}
+
+QRegularExpression HugeFileView::searchRegex(const SyntaxTextEdit::SearchParams &params)
+{
+    QString pattern = params.regex ? params.searchText
+                                   : QRegularExpression::escape(params.searchText);
+    if (params.wholeWord)
+        pattern = QStringLiteral("(?<!\\w)(?:%1)(?!\\w)").arg(pattern);
+    return SyntaxTextEdit::cachedRegex(pattern, params.caseSensitive
+                                                ? QRegularExpression::NoPatternOption
+                                                : QRegularExpression::CaseInsensitiveOption);
+}
+
+bool HugeFileView::find(const SyntaxTextEdit::SearchParams &params, bool reverse, bool wrap)
+{
+    if (!checkFileSize() || params.searchText.isEmpty())
+        return false;
+
+    const QRegularExpression re = searchRegex(params);
+    if (!re.isValid())
+        return false;
+
+    // Searching forward only needs the index as far as the search goes, but
+    // wrapping around backwards starts from the last line.
+    if (reverse) {
+        if (findBackward(re, m_cursorLine, m_cursorIndex))
+            return true;
+        return wrap && indexUntil(m_size)
+                && findBackward(re, m_lineCount - 1, std::numeric_limits<int>::max());
+    } else {
+        if (findForward(re, m_cursorLine, m_cursorIndex + m_matchLength))
+            return true;
+        return wrap && findForward(re, 0, 0);
+    }
+}
+
+// Searches are run over chunks of whole lines where possible, so a line is
+// only split between chunks if it's too long to decode in one go.  The line
+// break bytes decode to the same character in every supported encoding,
+// which we use to map matches back to lines.
+bool HugeFileView::findForward(const QRegularExpression &re, qint64 fromLine, int fromIndex)
+{
+    const QChar lineBreak = QLatin1Char(m_lineBreak);
+    qint64 line = fromLine;     // The line containing start
+    qint64 column = 0;          // Characters in that line before start
+    qint64 start = lineStart(fromLine);
+    for ( ;; ) {
+        qint64 end = qMin<qint64>(start + SEARCH_CHUNK_SIZE, m_size);
+        qint64 next = end;
+        if (end < m_size) {
+            const qint64 limit = qMin<qint64>(end + SEARCH_CHUNK_SIZE, m_size);
+            auto nextBreak = static_cast<const char *>(std::memchr(m_data + end, m_lineBreak,
+                                                                   limit - end));
+            if (nextBreak) {
+                end = next = nextBreak - m_data + 1;
+            } else if (limit == m_size) {
+                end = next = m_size;
+            } else {
+                // Start the next piece of this line a little before this
+                // one ends, so matches across the split are still found
+                end = splitPoint(end);
+                next = splitPoint(end - SEARCH_OVERLAP);
+            }
+        }
+
+        // Keep the index ahead of the search, so any line we find is in it.
+        // This is much quicker than decoding and searching the chunk.
+        if (!indexUntil(end))
+            return false;
+
+        // Matches starting at or after next are left for the next chunk
+        int nextIndex;
+        const QString text = decodeRange(start, next, end, &nextIndex);
+        qint64 matchLine = line;
+        int lineBegin = 0;
+        auto iter = re.globalMatch(text);
+        while (iter.hasNext()) {
+            const auto match = iter.next();
+            if (match.capturedLength() == 0)
+                continue;
+            const int pos = match.capturedStart();
+            if (pos >= nextIndex)
+                break;
+            for ( ;; ) {
+                const int nextLine = text.indexOf(lineBreak, lineBegin);
+                if (nextLine < 0 || nextLine >= pos)
+                    break;
+                lineBegin = nextLine + 1;
+                ++matchLine;
+            }
+            const qint64 matchColumn = pos - lineBegin + ((matchLine == line) ? column : 0);
+            if (matchLine == fromLine && matchColumn < fromIndex)
+                continue;
+            setCursorPosition(matchLine, clampIndex(matchColumn), match.capturedLength());
+            return true;
+        }
+
+        if (end >= m_size)
+            return false;
+        const int lastBreak = (nextIndex > 0) ? text.lastIndexOf(lineBreak, nextIndex - 1) : -1;
+        column = (lastBreak < 0) ? column + nextIndex : nextIndex - lastBreak - 1;
+        line += std::count(m_data + start, m_data + next, m_lineBreak);
+        start = next;
+    }
+}
+
+bool HugeFileView::findBackward(const QRegularExpression &re, qint64 fromLine, int fromIndex)
+{
+    const QChar lineBreak = QLatin1Char(m_lineBreak);
+    qint64 endLine = fromLine;      // The line containing end
+    qint64 end = lineEnd(lineStart(fromLine));
+    qint64 limit = end;             // Matches must start before this
+    for ( ;; ) {
+        qint64 start = m_dataStart;
+        if (end - SEARCH_CHUNK_SIZE > m_dataStart) {
+            start = findLineStart(end - SEARCH_CHUNK_SIZE, end - 2 * SEARCH_CHUNK_SIZE);
+            if (start < 0)
+                start = splitPoint(end - SEARCH_CHUNK_SIZE);
+        }
+
+        int limitIndex;
+        const QString text = decodeRange(start, limit, end, &limitIndex);
+        const qint64 firstLine = endLine - std::count(m_data + start, m_data + end, m_lineBreak);
+        const bool midLine = start > m_dataStart && m_data[start - 1] != m_lineBreak;
+        qint64 firstColumn = -1;
+        qint64 matchLine = firstLine;
+        int lineBegin = 0;
+        qint64 foundLine = -1, foundColumn = 0;
+        int foundLength = 0;
+        auto iter = re.globalMatch(text);
+        while (iter.hasNext()) {
+            const auto match = iter.next();
+            if (match.capturedLength() == 0)
+                continue;
+            const int pos = match.capturedStart();
+            if (pos >= limitIndex)
+                break;
+            for ( ;; ) {
+                const int nextLine = text.indexOf(lineBreak, lineBegin);
+                if (nextLine < 0 || nextLine >= pos)
+                    break;
+                lineBegin = nextLine + 1;
+                ++matchLine;
+            }
+            qint64 matchColumn = pos - lineBegin;
+            if (matchLine == firstLine && midLine) {
+                // Only count the rest of the line when we need it
+                if (firstColumn < 0)
+                    firstColumn = columnAt(start);
+                matchColumn += firstColumn;
+            }
+            if (matchLine == fromLine && matchColumn >= fromIndex)
+                break;
+            foundLine = matchLine;
+            foundColumn = matchColumn;
+            foundLength = match.capturedLength();
+        }
+        if (foundLine >= 0) {
+            setCursorPosition(foundLine, clampIndex(foundColumn), foundLength);
+            return true;
+        }
+
+        if (start <= m_dataStart)
+            return false;
+        if (midLine) {
+            // Search the rest of this line, overlapping this chunk a little
+            // so matches across the split are still found
+            end = splitPoint(qMin(start + SEARCH_OVERLAP, end));
+            limit = start;
+            endLine = firstLine + std::count(m_data + start, m_data + end, m_lineBreak);
+        } else {
+            // Skip the line break preceding this chunk
+            end = limit = start - 1;
+            endLine = firstLine - 1;
+        }
+    }
+}
+
+void HugeFileView::setLiveSearch(const SyntaxTextEdit::SearchParams &params)
+{
+    m_liveSearch = params;
+    m_liveSearchRegex = params.searchText.isEmpty() ? QRegularExpression()
+                                                    : searchRegex(params);
+    viewport()->update();
+}
+
+void HugeFileView::clearLiveSearch()
+{
+    m_liveSearch.searchText = QString();
+    m_liveSearchRegex = QRegularExpression();
+    viewport()->update();
+}
+
+void HugeFileView::copy()
+{
+    if (!checkFileSize())
+        return;
+
+    const QString text = lineText(m_cursorLine);
+    if (m_matchLength > 0)
+        QGuiApplication::clipboard()->setText(text.mid(m_cursorIndex, m_matchLength));
+    else
+        QGuiApplication::clipboard()->setText(text);
+}
+
+void HugeFileView::paintEvent(QPaintEvent *e)
+{
+    QPainter painter(viewport());
+    painter.fillRect(e->rect(), palette().color(QPalette::Base));
+    if (!checkFileSize())
+        return;
+
+    const QFontMetricsF metrics(font());
+    const int lineHeight = fontMetrics().height();
+    const qreal left = DOCUMENT_MARGIN - horizontalScrollBar()->value();
+    const bool liveSearch = !m_liveSearchRegex.pattern().isEmpty()
+                            && m_liveSearchRegex.isValid();
+    int maxLineWidth = m_maxLineWidth;
+
+    qint64 line = topLine();
+    if (line >= m_lineCount)
+        return;
+    qint64 start = lineStart(line);
+    for (int top = 0; line < m_lineCount && top <= e->rect().bottom(); ++line, top += lineHeight) {
+        const qint64 end = lineEnd(start);
+        const QString text = decodeLine(start, end);
+        QVector<int> indexMap;
+        const QString display = expandTabs(text, &indexMap);
+        const QRectF lineRect(0, top, viewport()->width(), lineHeight);
+
+        if (line == m_cursorLine)
+            painter.fillRect(lineRect, m_cursorLineBg);
+
+        if (liveSearch) {
+            auto iter = m_liveSearchRegex.globalMatch(text);
+            while (iter.hasNext()) {
+                const auto match = iter.next();
+                if (match.capturedLength() == 0)
+                    continue;
+                const qreal x1 = textX(display, indexMap.at(match.capturedStart()));
+                const qreal x2 = textX(display, indexMap.at(match.capturedEnd()));
+                painter.fillRect(QRectF(left + x1, top, x2 - x1, lineHeight), m_searchBg);
+            }
+        }
+
+        if (line == m_cursorLine) {
+            const int index = qMin(m_cursorIndex, text.size());
+            const qreal x1 = textX(display, indexMap.at(index));
+            if (m_matchLength > 0) {
+                const int matchEnd = qMin(index + m_matchLength, text.size());
+                const qreal x2 = textX(display, indexMap.at(matchEnd));
+                painter.fillRect(QRectF(left + x1, top, x2 - x1, lineHeight),
+                                 palette().color(QPalette::Highlight));
+            } else if (hasFocus()) {
+                painter.setPen(palette().color(QPalette::Text));
+                painter.drawLine(QPointF(left + x1, top), QPointF(left + x1, top + lineHeight - 1));
+            }
+        }
+
+        painter.setPen(palette().color(QPalette::Text));
+        painter.drawText(QPointF(left, top + metrics.ascent()), display);
+        maxLineWidth = qMax(maxLineWidth, qCeil(textWidth(metrics, display)) + 2 * DOCUMENT_MARGIN);
+
+        if (end >= m_size)
+            break;
+        start = end + 1;
+    }
+
+    if (maxLineWidth > m_maxLineWidth) {
+        m_maxLineWidth = maxLineWidth;
+        horizontalScrollBar()->setRange(0, qMax(0, m_maxLineWidth - viewport()->width()));
+    }
+}
+
+void HugeFileView::resizeEvent(QResizeEvent *e)
+{
+    QAbstractScrollArea::resizeEvent(e);
+    updateMargins();
+    updateScrollBars();
+}
+
+void HugeFileView::keyPressEvent(QKeyEvent *e)
+{
+    if (!checkFileSize()) {
+        QAbstractScrollArea::keyPressEvent(e);
+        return;
+    }
+
+    if (e->matches(QKeySequence::Copy)) {
+        copy();
+        return;
+    }
+
+    const bool ctrl = (e->modifiers() & Qt::ControlModifier) != 0;
+    switch (e->key()) {
+    case Qt::Key_Up:
+        setCursorPosition(m_cursorLine - 1, m_cursorIndex);
+        break;
+    case Qt::Key_Down:
+        setCursorPosition(m_cursorLine + 1, m_cursorIndex);
+        break;
+    case Qt::Key_PageUp:
+        setCursorPosition(m_cursorLine - visibleLines(), m_cursorIndex);
+        break;
+    case Qt::Key_PageDown:
+        setCursorPosition(m_cursorLine + visibleLines(), m_cursorIndex);
+        break;
+    case Qt::Key_Left:
+        if (m_cursorIndex > 0)
+            setCursorPosition(m_cursorLine, qMin(m_cursorIndex, lineText(m_cursorLine).size()) - 1);
+        else if (m_cursorLine > 0)
+            setCursorPosition(m_cursorLine - 1, lineText(m_cursorLine - 1).size());
+        break;
+    case Qt::Key_Right:
+        if (m_cursorIndex < lineText(m_cursorLine).size())
+            setCursorPosition(m_cursorLine, m_cursorIndex + 1);
+        else if (m_cursorLine + 1 < m_lineCount)
+            setCursorPosition(m_cursorLine + 1, 0);
+        break;
+    case Qt::Key_Home:
+        setCursorPosition(ctrl ? 0 : m_cursorLine, 0);
+        break;
+    case Qt::Key_End:
+        if (ctrl) {
+            if (!indexUntil(m_size))
+                break;
+            setCursorPosition(m_lineCount - 1, lineText(m_lineCount - 1).size());
+        } else {
+            setCursorPosition(m_cursorLine, lineText(m_cursorLine).size());
+        }
+        break;
+    default:
+        QAbstractScrollArea::keyPressEvent(e);
+        break;
+    }
+}
+
+void HugeFileView::mousePressEvent(QMouseEvent *e)
+{
+    if (e->button() != Qt::LeftButton || !checkFileSize()) {
+        QAbstractScrollArea::mousePressEvent(e);
+        return;
+    }
+
+    const qint64 line = topLine() + e->pos().y() / fontMetrics().height();
+    if (line >= m_lineCount)
+        return;
+    const qreal x = e->pos().x() - DOCUMENT_MARGIN + horizontalScrollBar()->value();
+    setCursorPosition(line, indexAt(lineText(line), x));
+}
+
+void HugeFileView::scrollContentsBy(int, int)
+{
+    viewport()->update();
+    m_lineMargin->update();
+}
+
+void HugeFileView::changeEvent(QEvent *e)
+{
+    QAbstractScrollArea::changeEvent(e);
+    if (e->type() == QEvent::FontChange) {
+        m_lineMargin->setFont(font());
+        m_maxLineWidth = 0;
+        updateMargins();
+        updateScrollBars();
+        viewport()->update();
+    }
+}
+
+void HugeFileView::LineMargin::paintEvent(QPaintEvent *paintEvent)
+{
+    QPainter painter(this);
+    painter.fillRect(paintEvent->rect(), m_view->m_lineMarginBg);
+    if (!m_view->m_data)
+        return;
+
+    const QFontMetricsF metrics(font());
+    const int lineHeight = m_view->fontMetrics().height();
+    const qreal numOffset = metrics.boundingRect(QLatin1Char('0')).width() / 2.0;
+    qint64 line = m_view->topLine();
+    for (int top = 0; line < m_view->m_lineCount && top <= paintEvent->rect().bottom();
+         ++line, top += lineHeight) {
+        if (line == m_view->m_cursorLine)
+            painter.setPen(m_view->m_cursorLineNum);
+        else
+            painter.setPen(m_view->m_lineMarginFg);
+        const QRectF numberRect(0, top, width() - numOffset, metrics.height());
+        painter.drawText(numberRect, Qt::AlignRight, QString::number(line + 1));
+    }
+}
@@ -0,0 +1,196 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QTEXTPAD_HUGEFILEVIEW_H
+#define QTEXTPAD_HUGEFILEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QFile>
+#include <QVector>
+#include <QRegularExpression>
+
+#include <limits>
+
+#include "syntaxtextedit.h"
+#include "filetypeinfo.h"
+
+class TextCodec;
+class QTimer;
+class QFileSystemWatcher;
+
+namespace KSyntaxHighlighting
+{
+    class Theme;
+}
+
+// Read-only viewer for files that are too large to load into a QTextDocument.
+// The file is memory-mapped, and only a sparse index of line offsets is kept
+// in memory.  Lines are decoded on demand as they are painted or searched,
+// so memory use does not depend on the size of the file.
+//
+// Touching a mapped page that's past the end of the file crashes with
+// SIGBUS, so the file is watched, and its size is checked again before the
+// mapping is used.  If another program truncates the file, it's reopened.
+class HugeFileView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit HugeFileView(QWidget *parent = Q_NULLPTR);
+    ~HugeFileView() Q_DECL_OVERRIDE;
+
+    // If codec is null, the encoding is detected from the file contents.
+    bool openFile(const QString &filename, TextCodec *codec = Q_NULLPTR);
+    void closeFile();
+    bool isOpen() const { return m_data != Q_NULLPTR; }
+    QString errorString() const { return m_errorString; }
+
+    TextCodec *textCodec() const { return m_codec; }
+    int bomOffset() const { return static_cast<int>(m_dataStart); }
+    FileTypeInfo::LineEndingType lineEndings() const { return m_lineEndings; }
+
+    // Number of lines found so far.  The index is built in the background,
+    // so this keeps growing until isIndexing() returns false.
+    qint64 lineCount() const { return m_lineCount; }
+    bool isIndexing() const;
+
+    // 0-based line and character index of the cursor
+    qint64 cursorLine() const { return m_cursorLine; }
+    int cursorColumn() const;
+
+    // Same semantics as SyntaxTextEdit::moveCursorTo()
+    void moveCursorTo(qint64 line, int column = 0);
+
+    bool find(const SyntaxTextEdit::SearchParams &params, bool reverse, bool wrap);
+    void setLiveSearch(const SyntaxTextEdit::SearchParams &params);
+    void clearLiveSearch();
+
+    void setTheme(const KSyntaxHighlighting::Theme &theme);
+    void setShowLineNumbers(bool show);
+    bool showLineNumbers() const { return m_showLineNumbers; }
+    void setTabWidth(int width);
+    int tabWidth() const { return m_tabCharSize; }
+
+    int lineMarginWidth();
+
+    static bool canDisplay(TextCodec *codec);
+
+signals:
+    void cursorPositionChanged();
+
+public slots:
+    void copy();
+
+protected:
+    void paintEvent(QPaintEvent *e) Q_DECL_OVERRIDE;
+    void resizeEvent(QResizeEvent *e) Q_DECL_OVERRIDE;
+    void keyPressEvent(QKeyEvent *e) Q_DECL_OVERRIDE;
+    void mousePressEvent(QMouseEvent *e) Q_DECL_OVERRIDE;
+    void scrollContentsBy(int dx, int dy) Q_DECL_OVERRIDE;
+    void changeEvent(QEvent *e) Q_DECL_OVERRIDE;
+
+private slots:
+    void indexNextChunk();
+
+private:
+    QFile m_file;
+    QFileSystemWatcher *m_watcher;
+    quint64 m_openCount;
+    const char *m_data;
+    qint64 m_size;
+    qint64 m_dataStart;
+    TextCodec *m_codec;
+    FileTypeInfo::LineEndingType m_lineEndings;
+    char m_lineBreak;
+    QString m_errorString;
+
+    // Byte offset of the start of every LINE_INDEX_STRIDE'th line
+    QVector<qint64> m_lineIndex;
+    qint64 m_lineCount;
+    qint64 m_indexedTo;
+    QTimer *m_indexTimer;
+
+    qint64 m_cursorLine;
+    int m_cursorIndex;
+    int m_matchLength;
+    int m_maxLineWidth;
+
+    SyntaxTextEdit::SearchParams m_liveSearch;
+    QRegularExpression m_liveSearchRegex;
+
+    QWidget *m_lineMargin;
+    bool m_showLineNumbers;
+    int m_tabCharSize;
+    QColor m_lineMarginBg, m_lineMarginFg;
+    QColor m_cursorLineBg, m_cursorLineNum;
+    QColor m_searchBg;
+
+    // Returns false (after reopening the file) if the file has shrunk since
+    // it was mapped
+    bool checkFileSize();
+    void reopenFile();
+
+    void indexSlice();
+
+    // Indexes the file on this thread until offset has been indexed or
+    // lineCount lines have been found, showing a progress dialog if that's
+    // going to take a while.  Returns false if it was cancelled, or if the
+    // file had to be reopened in the meantime.
+    bool indexUntil(qint64 offset,
+                    qint64 lineCount = std::numeric_limits<qint64>::max());
+    qint64 lineStart(qint64 line) const;
+    qint64 lineEnd(qint64 start) const;
+    // Returns -1 if there's no line start between minOffset and offset
+    qint64 findLineStart(qint64 offset, qint64 minOffset = 0) const;
+    qint64 splitPoint(qint64 offset) const;
+    qint64 columnAt(qint64 offset) const;
+    QString decodeRange(qint64 start, qint64 split, qint64 end, int *splitIndex) const;
+    QString decodeLine(qint64 start, qint64 end) const;
+    QString lineText(qint64 line) const;
+    QString expandTabs(const QString &text, QVector<int> *indexMap = Q_NULLPTR) const;
+    qreal textX(const QString &text, int index) const;
+
+    qint64 topLine() const;
+    int visibleLines() const;
+    void ensureCursorVisible();
+    void setCursorPosition(qint64 line, int index, int matchLength = 0);
+    bool findForward(const QRegularExpression &re, qint64 fromLine, int fromIndex);
+    bool findBackward(const QRegularExpression &re, qint64 fromLine, int fromIndex);
+    int indexAt(const QString &text, qreal x) const;
+    void updateScrollBars();
+    void updateMargins();
+
+    static QRegularExpression searchRegex(const SyntaxTextEdit::SearchParams &params);
+
+    class LineMargin : public QWidget
+    {
+    public:
+        explicit LineMargin(HugeFileView *view) : QWidget(view), m_view(view) { }
+
+        QSize sizeHint() const Q_DECL_OVERRIDE
+        {
+            return QSize(m_view->lineMarginWidth(), 0);
+        }
+
+    protected:
+        void paintEvent(QPaintEvent *e) Q_DECL_OVERRIDE;
+
+    private:
+        HugeFileView *m_view;
+    };
+};
+
+#endif // QTEXTPAD_HUGEFILEVIEW_H
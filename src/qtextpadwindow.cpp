@@ -24,6 +24,9 @@
 #include <QMenuBar>
 #include <QToolBar>
 #include <QStatusBar>
+#include <QProgressBar>
+#include <QScrollBar>
+#include <QStackedWidget>
 #include <QFontDialog>
 #include <QApplication>
 #include <QWidgetAction>
@@ -41,6 +44,7 @@
 #include <QDateTime>
 #include <QProcess>
 #include <QFileSystemWatcher>
+#include <QStyle>
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
 #include <QGuiApplication>
@@ -55,17 +59,26 @@
 #include "syntaxtextedit.h"
 #include "settingspopup.h"
 #include "searchdialog.h"
+#include "findinfilesdialog.h"
 #include "definitiondownload.h"
 #include "indentsettings.h"
 #include "appsettings.h"
 #include "undocommands.h"
 #include "charsets.h"
+#include "documentloader.h"
+#include "documentsaver.h"
+#include "documentwriter.h"
+#include "hugefileview.h"
+#include "encodingtracker.h"
 #include "aboutdialog.h"
 
 #include <memory>
 
 #define LARGE_FILE_SIZE     (10*1024*1024)  // 10 MiB
-#define DETECTION_SIZE      (      4*1024)
+
+// Documents with more characters than this are saved straight from the
+// document rather than from a snapshot, which would double their memory use
+#define STREAM_SAVE_SIZE    (32*1024*1024)
 
 class EncodingPopupAction : public QWidgetAction
 {
@@ -122,11 +135,19 @@ protected:
 };
 
 QTextPadWindow::QTextPadWindow(QWidget *parent)
-    : QMainWindow(parent), m_fileState()
+    : QMainWindow(parent), m_fileState(), m_loader(), m_pendingLine(), m_pendingColumn(),
+      m_pendingScroll(-1), m_saver(), m_savingCurrent()
 {
     m_editor = new SyntaxTextEdit(this);
-    setCentralWidget(m_editor);
     m_editor->setFrameStyle(QFrame::NoFrame);
+    m_hugeView = new HugeFileView(this);
+    m_hugeView->setFrameStyle(QFrame::NoFrame);
+    m_editorStack = new QStackedWidget(this);
+    m_editorStack->addWidget(m_editor);
+    m_editorStack->addWidget(m_hugeView);
+    setCentralWidget(m_editorStack);
+
+    m_encodingTracker = new EncodingTracker(m_editor->document(), this);
 
     m_searchWidget = new SearchWidget(this);
     showSearchBar(false);
@@ -233,6 +254,8 @@ QTextPadWindow::QTextPadWindow(QWidget *parent)
     findPrevAction->setShortcut(Qt::SHIFT | Qt::Key_F3);
     auto replaceAction = editMenu->addAction(ICON("edit-find-replace"), tr("R&eplace..."));
     replaceAction->setShortcut(Qt::CTRL | Qt::Key_H);
+    auto findInFilesAction = editMenu->addAction(tr("Find in F&iles..."));
+    findInFilesAction->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_F);
     (void) editMenu->addSeparator();
     auto gotoAction = editMenu->addAction(ICON("go-jump"), tr("&Go to line..."));
     gotoAction->setShortcut(Qt::CTRL | Qt::Key_G);
@@ -240,7 +263,12 @@ QTextPadWindow::QTextPadWindow(QWidget *parent)
     connect(undoAction, &QAction::triggered, m_undoStack, &QUndoStack::undo);
     connect(redoAction, &QAction::triggered, m_undoStack, &QUndoStack::redo);
     connect(cutAction, &QAction::triggered, m_editor, &SyntaxTextEdit::cutLines);
-    connect(copyAction, &QAction::triggered, m_editor, &SyntaxTextEdit::copyLines);
+    connect(copyAction, &QAction::triggered, this, [this] {
+        if (isHugeFileMode())
+            m_hugeView->copy();
+        else
+            m_editor->copyLines();
+    });
     connect(pasteAction, &QAction::triggered, m_editor, &QPlainTextEdit::paste);
     connect(clearAction, &QAction::triggered, m_editor, &SyntaxTextEdit::deleteSelection);
     connect(deleteLinesAction, &QAction::triggered, m_editor, &SyntaxTextEdit::deleteLines);
@@ -251,7 +279,16 @@ QTextPadWindow::QTextPadWindow(QWidget *parent)
     connect(findAction, &QAction::triggered, this, [this] { showSearchBar(true); });
     connect(findNextAction, &QAction::triggered, this, [this] { m_searchWidget->searchNext(false); });
     connect(findPrevAction, &QAction::triggered, this, [this] { m_searchWidget->searchNext(true); });
-    connect(replaceAction, &QAction::triggered, this, [this] { SearchDialog::create(this); });
+    connect(replaceAction, &QAction::triggered, this, [this] {
+        // The large file viewer is read-only, so we can only search
+        if (isHugeFileMode())
+            showSearchBar(true);
+        else
+            SearchDialog::create(this);
+    });
+    connect(findInFilesAction, &QAction::triggered, this, [this] {
+        FindInFilesDialog::create(this);
+    });
     connect(gotoAction, &QAction::triggered, this, &QTextPadWindow::navigateToLine);
 
     connect(m_undoStack, &QUndoStack::canUndoChanged, undoAction, &QAction::setEnabled);
@@ -284,6 +321,7 @@ QTextPadWindow::QTextPadWindow(QWidget *parent)
     longLineAction->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_M);
     longLineAction->setCheckable(true);
     auto longLineWidthAction = viewMenu->addAction(tr("Set Long Line Wi&dth..."));
+    auto hugeFileThresholdAction = viewMenu->addAction(tr("Set &Large File Viewer Threshold..."));
     auto indentGuidesAction = viewMenu->addAction(tr("&Indentation Guides"));
     indentGuidesAction->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_T);
     indentGuidesAction->setCheckable(true);
@@ -329,6 +367,8 @@ QTextPadWindow::QTextPadWindow(QWidget *parent)
             });
     connect(longLineWidthAction, &QAction::triggered,
             this, &QTextPadWindow::promptLongLineWidth);
+    connect(hugeFileThresholdAction, &QAction::triggered,
+            this, &QTextPadWindow::promptHugeFileThreshold);
     connect(indentGuidesAction, &QAction::toggled, this,
             [this](bool show) {
                 m_editor->setShowIndentGuides(show);
@@ -337,6 +377,7 @@ QTextPadWindow::QTextPadWindow(QWidget *parent)
     connect(showLineNumbersAction, &QAction::toggled, this,
             [this](bool show) {
                 m_editor->setShowLineNumbers(show);
+                m_hugeView->setShowLineNumbers(show);
                 QTextPadSettings().setLineNumbers(show);
             });
     connect(showFoldingAction, &QAction::toggled, this,
@@ -495,6 +536,22 @@ QTextPadWindow::QTextPadWindow(QWidget *parent)
 
     m_positionLabel = new ActivationLabel(this);
     statusBar()->addWidget(m_positionLabel, 1);
+    m_loadProgress = new QProgressBar(this);
+    m_loadProgress->setRange(0, 100);
+    m_loadProgress->setMaximumWidth(150);
+    m_loadProgress->setVisible(false);
+    statusBar()->addPermanentWidget(m_loadProgress);
+    m_cancelLoadButton = new QToolButton(this);
+    m_cancelLoadButton->setAutoRaise(true);
+    m_cancelLoadButton->setIcon(ICON("process-stop"));
+    m_cancelLoadButton->setText(tr("Cancel"));
+    m_cancelLoadButton->setToolTip(tr("Cancel loading"));
+    m_cancelLoadButton->setVisible(false);
+    connect(m_cancelLoadButton, &QToolButton::clicked, this, &QTextPadWindow::cancelLoading);
+    statusBar()->addPermanentWidget(m_cancelLoadButton);
+    m_saveIndicator = new QLabel(tr("Saving..."), this);
+    m_saveIndicator->setVisible(false);
+    statusBar()->addPermanentWidget(m_saveIndicator);
     m_insertLabel = new ActivationLabel(this);
     statusBar()->addPermanentWidget(m_insertLabel);
     m_crlfLabel = new ActivationLabel(this);
@@ -553,15 +610,31 @@ QTextPadWindow::QTextPadWindow(QWidget *parent)
 
     connect(m_editor, &SyntaxTextEdit::cursorPositionChanged,
             this, &QTextPadWindow::updateCursorPosition);
+    connect(m_encodingTracker, &EncodingTracker::encodableChanged,
+            this, &QTextPadWindow::updateEncodingStatus);
     connect(m_editor, &SyntaxTextEdit::selectionChanged,
             this, &QTextPadWindow::updateCursorPosition);
+    connect(m_hugeView, &HugeFileView::cursorPositionChanged,
+            this, &QTextPadWindow::updateCursorPosition);
     connect(m_undoStack, &QUndoStack::cleanChanged, this,
             [this](bool) { updateTitle(); });
 
     connect(m_editor, &SyntaxTextEdit::textChanged, [this] {
-        if (m_searchWidget->isVisible())
+        if (m_searchWidget->isVisible() && !m_editor->isPopulating())
             showSearchBar(false);
     });
+    connect(m_editor, &SyntaxTextEdit::populationFinished, this, [this] {
+        if (m_pendingLine > 0) {
+            const int line = m_pendingLine;
+            m_pendingLine = 0;
+            gotoLine(line, m_pendingColumn);
+        }
+        if (m_pendingScroll >= 0) {
+            const int scroll = m_pendingScroll;
+            m_pendingScroll = -1;
+            scrollEditorTo(scroll);
+        }
+    });
     connect(qApp, &QApplication::focusChanged, [this](QWidget *, QWidget *focus) {
         if (focus == m_editor && m_searchWidget->isVisible())
             showSearchBar(false);
@@ -632,17 +705,27 @@ void QTextPadWindow::showSearchBar(bool show)
     m_searchWidget->setEnabled(show);
     if (show) {
         const QTextCursor cursor = m_editor->textCursor();
-        if (cursor.hasSelection())
+        if (cursor.hasSelection() && !isHugeFileMode())
             m_searchWidget->setSearchText(cursor.selectedText());
         m_searchWidget->activate();
     } else {
         m_editor->clearLiveSearch();
-        m_editor->setFocus(Qt::OtherFocusReason);
+        m_hugeView->clearLiveSearch();
+        if (isHugeFileMode())
+            m_hugeView->setFocus(Qt::OtherFocusReason);
+        else
+            m_editor->setFocus(Qt::OtherFocusReason);
     }
 }
 
 void QTextPadWindow::setSyntax(const KSyntaxHighlighting::Definition &syntax)
 {
+    if (m_loader) {
+        // Applied once the new document has finished loading
+        m_pendingSyntax = syntax;
+        return;
+    }
+
     m_editor->setSyntax(syntax);
     if (syntax.isValid())
         m_syntaxButton->setText(syntax.translatedName());
@@ -662,6 +745,7 @@ void QTextPadWindow::setSyntax(const KSyntaxHighlighting::Definition &syntax)
 void QTextPadWindow::setEditorTheme(const KSyntaxHighlighting::Theme &theme)
 {
     m_editor->setTheme(theme);
+    m_hugeView->setTheme(theme);
 
     // Update the menus when this is triggered via other callers
     for (const auto &action : m_themeActions->actions()) {
@@ -681,6 +765,7 @@ void QTextPadWindow::setEditorTheme(const KSyntaxHighlighting::Theme &theme)
 void QTextPadWindow::setDefaultEditorTheme()
 {
     m_editor->setDefaultTheme();
+    m_hugeView->setTheme(SyntaxTextEdit::syntaxRepo()->theme(m_editor->themeName()));
     m_defaultThemeAction->setChecked(true);
     QTextPadSettings().clearEditorTheme();
 }
@@ -694,13 +779,16 @@ void QTextPadWindow::setEncoding(const QString &codecName)
     if (m_setEncodingActions->checkedAction())
         m_setEncodingActions->checkedAction()->setChecked(false);
 
-    if (!QTextPadCharsets::codecForName(codecName.toLatin1())) {
+    TextCodec *codec = QTextPadCharsets::codecForName(codecName.toLatin1());
+    if (!codec) {
         qWarning("Invalid codec selected");
         m_encodingButton->setText(tr("Invalid (%1)").arg(codecName));
     } else {
         // Use the passed name for UI consistency
         m_encodingButton->setText(codecName);
     }
+    m_encodingTracker->setCodec(codec);
+    updateEncodingStatus();
 
     // Update the menus when this is triggered via other callers
     for (const auto &action : m_setEncodingActions->actions()) {
@@ -712,6 +800,20 @@ void QTextPadWindow::setEncoding(const QString &codecName)
     }
 }
 
+void QTextPadWindow::updateEncodingStatus()
+{
+    if (m_encodingTracker->canEncodeDocument() || !m_encodingTracker->codec()) {
+        m_encodingButton->setIcon(QIcon());
+        m_encodingButton->setToolButtonStyle(Qt::ToolButtonTextOnly);
+        m_encodingButton->setToolTip(QString());
+    } else {
+        m_encodingButton->setIcon(style()->standardIcon(QStyle::SP_MessageBoxWarning));
+        m_encodingButton->setToolButtonStyle(Qt::ToolButtonTextBesideIcon);
+        m_encodingButton->setToolTip(tr("The document contains characters that can't be "
+                                        "represented in %1").arg(m_textEncoding));
+    }
+}
+
 bool QTextPadWindow::utfBOM() const
 {
     return m_utfBOMAction->isChecked();
@@ -762,26 +864,20 @@ void QTextPadWindow::setLineEndingMode(FileTypeInfo::LineEndingType mode)
     }
 }
 
-static QString convertRawText(const QString &text)
+bool QTextPadWindow::startSave(const QString &filename, unsigned int flags)
 {
-    QString result = text;
-    for (auto dp = result.begin(); dp != result.end(); ++dp) {
-        switch (dp->unicode()) {
-        case 0xfdd0:    // Used internally by QTextDocument
-        case 0xfdd1:    // Used internally by QTextDocument
-        case QChar::ParagraphSeparator:
-        case QChar::LineSeparator:
-            *dp = QLatin1Char('\n');
-            break;
-        default:
-            break;
-        }
+    if (isHugeFileMode()) {
+        QMessageBox::critical(this, QString(),
+                              tr("Files opened in the large file viewer are read-only."));
+        return false;
+    }
+
+    if (m_loader) {
+        QMessageBox::critical(this, QString(),
+                              tr("Please wait for the current file to finish loading."));
+        return false;
     }
-    return result;
-}
 
-bool QTextPadWindow::saveDocumentTo(const QString &filename)
-{
     auto codec = QTextPadCharsets::codecForName(m_textEncoding.toLatin1());
     if (!codec) {
         QMessageBox::critical(this, QString(),
@@ -790,37 +886,101 @@ bool QTextPadWindow::saveDocumentTo(const QString &filename)
         return false;
     }
 
-    QFile file(filename);
-    if (!file.open(QIODevice::WriteOnly)) {
-        QMessageBox::critical(this, QString(),
-                              tr("Cannot open file %1 for writing").arg(filename));
-        return false;
+    // Only one save can be in progress at a time
+    (void)waitForSave();
+
+    // Make sure we don't save a partially populated document
+    m_editor->finishPopulation();
+
+    if (!m_encodingTracker->canEncodeDocument()) {
+        const int line = m_encodingTracker->firstUnencodableBlock() + 1;
+        const auto response = QMessageBox::warning(this, QString(),
+                tr("Some characters (starting on line %1) can't be represented in "
+                   "the %2 encoding, and will be replaced when the file is saved.  "
+                   "Save anyway?").arg(line).arg(m_textEncoding),
+                QMessageBox::Save | QMessageBox::Cancel, QMessageBox::Cancel);
+        if (response != QMessageBox::Save)
+            return false;
     }
 
-    auto document = convertRawText(m_editor->document()->toRawText());
-    switch (m_lineEndingMode) {
-    case FileTypeInfo::CROnly:
-        document.replace(QLatin1Char('\n'), QLatin1Char('\r'));
-        break;
-    case FileTypeInfo::LFOnly:
-        // No action
-        break;
-    case FileTypeInfo::CRLF:
-        document.replace(QLatin1Char('\n'), QStringLiteral("\r\n"));
-        break;
+    const bool currentDocument = (flags & Save_CurrentDocument) != 0;
+    if (m_editor->document()->characterCount() > STREAM_SAVE_SIZE) {
+        // This blocks editing until the file is written, since the
+        // document can't change while its blocks are being read.
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        DocumentSaver saver(filename, m_editor->document(), codec,
+                            m_lineEndingMode, utfBOM());
+        saver.save();
+        QApplication::restoreOverrideCursor();
+        if (currentDocument)
+            m_undoStack->setClean();
+        return finishSaving(&saver, currentDocument);
     }
 
-    const auto buffer = codec->fromUnicode(document, utfBOM());
-    qint64 count = file.write(buffer);
-    if (count < 0) {
-        QMessageBox::critical(this, QString(),
-                              tr("Error writing to file: %1").arg(file.errorString()));
-        return false;
-    } else if (count != buffer.size()) {
-        QMessageBox::critical(this, QString(), tr("Error: File truncated while writing"));
+    // Encode and write a snapshot of the document on a worker thread, so
+    // editing can continue while the file is written.  The document is
+    // clean as of the snapshot; edits made during the save mark it as
+    // modified again as usual.
+    m_saver = new DocumentSaver(filename, m_editor->document()->toRawText(), codec,
+                                m_lineEndingMode, utfBOM(), this);
+    m_savingCurrent = currentDocument;
+    connect(m_saver, &QThread::finished, this, &QTextPadWindow::saverFinished);
+    if (currentDocument)
+        m_undoStack->setClean();
+
+    m_saveIndicator->setText(tr("Saving %1...").arg(QFileInfo(filename).fileName()));
+    m_saveIndicator->setVisible(true);
+    m_saver->start();
+    return true;
+}
+
+void QTextPadWindow::saverFinished()
+{
+    DocumentSaver *saver = m_saver;
+    if (!saver || sender() != saver)
+        return;
+
+    m_saver = Q_NULLPTR;
+    m_saveIndicator->setVisible(false);
+    (void)finishSaving(saver, m_savingCurrent);
+    saver->deleteLater();
+}
+
+bool QTextPadWindow::waitForSave()
+{
+    if (!m_saver)
+        return true;
+
+    DocumentSaver *saver = m_saver;
+    m_saver = Q_NULLPTR;
+    saver->wait();
+    m_saveIndicator->setVisible(false);
+    const bool result = finishSaving(saver, m_savingCurrent);
+    saver->deleteLater();
+    return result;
+}
+
+bool QTextPadWindow::finishSaving(DocumentSaver *saver, bool currentDocument)
+{
+    const QString filename = saver->filename();
+    if (!saver->succeeded()) {
+        QMessageBox::critical(this, QString(), saver->errorString());
+        if (currentDocument) {
+            // The document no longer matches any saved revision
+            m_undoStack->resetClean();
+            updateTitle();
+        }
         return false;
     }
 
+    if (currentDocument) {
+        // The file was replaced, so this also renews the file system watch
+        setOpenFilename(filename);
+        m_fileState = 0;
+        m_cachedModTime = QFileInfo(filename).lastModified();
+        updateTitle();
+    }
+
     const QTextCursor cursor = m_editor->textCursor();
     QTextPadSettings::setFileModes(filename, m_textEncoding, m_editor->syntaxName(),
                                    cursor.blockNumber() + 1);
@@ -832,9 +992,16 @@ bool QTextPadWindow::saveDocumentTo(const QString &filename)
 
 bool QTextPadWindow::loadDocumentFrom(const QString &filename, const QString &textEncoding)
 {
-    QFile file(filename);
-    if (!file.exists()) {
+    return startLoad(filename, textEncoding, 0);
+}
+
+bool QTextPadWindow::startLoad(const QString &filename, const QString &textEncoding,
+                               unsigned int flags)
+{
+    QFileInfo info(filename);
+    if (!info.exists()) {
         // Creating a new file
+        abortLoading();
         resetEditor();
 
         KSyntaxHighlighting::Definition definition =
@@ -849,13 +1016,22 @@ bool QTextPadWindow::loadDocumentFrom(const QString &filename, const QString &te
         return true;
     }
 
-    if (!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::critical(this, QString(),
-                              tr("Cannot open file %1 for reading").arg(filename));
-        return false;
-    }
+    const auto fileModes = QTextPadSettings::fileModes(filename);
+    const QString codecName = textEncoding.isEmpty() ? fileModes.encoding : textEncoding;
 
-    if (file.size() > LARGE_FILE_SIZE) {
+    // Very large files go to the read-only viewer, unless it can't
+    // handle the file's encoding.
+    const qint64 hugeFileSize = qint64(QTextPadSettings().hugeFileThreshold()) * 1024 * 1024;
+    if (hugeFileSize > 0 && info.size() >= hugeFileSize && openHugeFile(filename, codecName))
+        return true;
+
+    // Reuse the contents we read last time if the file hasn't changed since
+    const bool useCachedData = (flags & Load_CachedData) != 0
+                            && (m_fileState & FS_OutOfDate) == 0
+                            && filename == m_openFilename;
+
+    const bool largeFile = info.size() > LARGE_FILE_SIZE;
+    if (largeFile && !useCachedData) {
         int response = QMessageBox::question(this, QString(),
                             tr("Warning: Are you sure you want to open this large file?"),
                             QMessageBox::Yes | QMessageBox::No);
@@ -863,37 +1039,125 @@ bool QTextPadWindow::loadDocumentFrom(const QString &filename, const QString &te
             return false;
     }
 
-    const auto fileModes = QTextPadSettings::fileModes(filename);
-    const QString codecName = textEncoding.isEmpty() ? fileModes.encoding : textEncoding;
+    // Only drop a load that's still in progress once we know we're going
+    // to replace it, so a declined prompt doesn't cancel it.
+    abortLoading();
 
-    auto buffer = file.read(DETECTION_SIZE);
-    auto detect = FileTypeInfo::detect(buffer);
-    setLineEndingMode(detect.lineEndings());
+    if (!largeFile) {
+        DocumentLoader loader(filename, codecName.toLatin1());
+        if (useCachedData)
+            loader.setCachedModTime(m_cachedModTime);
+        loader.load();
+        return finishLoading(&loader);
+    }
 
-    TextCodec *codec = Q_NULLPTR;
-    if (!codecName.isEmpty()) {
-        codec = QTextPadCharsets::codecForName(codecName.toLatin1());
-        if (!codec) {
-            qDebug("Invalid manually-specified encoding: %s",
-                   codecName.toLocal8Bit().constData());
-        }
+    // Large files are read and decoded on a background thread, so the
+    // window stays responsive and the load can be cancelled.  The current
+    // document stays visible (but read-only) until the new one is ready.
+    m_loader = new DocumentLoader(filename, codecName.toLatin1(), this);
+    if (useCachedData)
+        m_loader->setCachedModTime(m_cachedModTime);
+    m_pendingLine = 0;
+    m_pendingColumn = 0;
+    m_pendingScroll = -1;
+    m_pendingSyntax = KSyntaxHighlighting::Definition();
+    connect(m_loader, &DocumentLoader::progress, m_loadProgress, &QProgressBar::setValue);
+    connect(m_loader, &QThread::finished, this, &QTextPadWindow::loaderFinished);
+
+    showSearchBar(false);
+    m_editor->setReadOnly(true);
+    m_loadProgress->setValue(0);
+    m_loadProgress->setVisible(true);
+    m_cancelLoadButton->setVisible(true);
+    statusBar()->showMessage(tr("Loading %1...").arg(info.fileName()));
+
+    m_loader->start();
+    return true;
+}
+
+void QTextPadWindow::cancelLoading()
+{
+    if (m_loader)
+        m_loader->cancel();
+}
+
+void QTextPadWindow::loaderFinished()
+{
+    DocumentLoader *loader = m_loader;
+    if (!loader || sender() != loader)
+        return;
+
+    m_loader = Q_NULLPTR;
+    m_loadProgress->setVisible(false);
+    m_cancelLoadButton->setVisible(false);
+    m_editor->setReadOnly(false);
+    statusBar()->clearMessage();
+
+    const int pendingLine = m_pendingLine;
+    const int pendingColumn = m_pendingColumn;
+    const int pendingScroll = m_pendingScroll;
+    m_pendingLine = 0;
+    m_pendingScroll = -1;
+    if (finishLoading(loader)) {
+        if (pendingLine > 0)
+            gotoLine(pendingLine, pendingColumn);
+        if (pendingScroll >= 0)
+            scrollEditorTo(pendingScroll);
+        if (m_pendingSyntax.isValid())
+            setSyntax(m_pendingSyntax);
+    } else if (loader->wasCancelled()) {
+        statusBar()->showMessage(tr("Loading of %1 was cancelled")
+                                 .arg(QFileInfo(loader->filename()).fileName()), 5000);
     }
-    if (!codec)
-        codec = detect.textCodec();
-    setEncoding(QString::fromLatin1(codec->name()));
+    loader->deleteLater();
+}
+
+void QTextPadWindow::abortLoading()
+{
+    if (!m_loader)
+        return;
+
+    DocumentLoader *loader = m_loader;
+    m_loader = Q_NULLPTR;
+    disconnect(loader, Q_NULLPTR, this, Q_NULLPTR);
+    disconnect(loader, Q_NULLPTR, m_loadProgress, Q_NULLPTR);
+    loader->cancel();
+    loader->wait();
+    loader->deleteLater();
 
-    buffer.append(file.readAll());
-    QString document = codec->toUnicode(buffer);
-    if (!document.isEmpty() && document[0] == QChar(0xFEFF))
-        document = document.mid(1);
+    m_loadProgress->setVisible(false);
+    m_cancelLoadButton->setVisible(false);
+    m_editor->setReadOnly(false);
+    statusBar()->clearMessage();
+}
+
+bool QTextPadWindow::finishLoading(DocumentLoader *loader)
+{
+    if (loader->wasCancelled())
+        return false;
+    if (!loader->succeeded()) {
+        QMessageBox::critical(this, QString(), loader->errorString());
+        return false;
+    }
+
+    const QString filename = loader->filename();
+    const auto fileModes = QTextPadSettings::fileModes(filename);
+    const FileTypeInfo &detect = loader->fileType();
+    setLineEndingMode(detect.lineEndings());
+    setEncoding(QString::fromLatin1(loader->textCodec()->name()));
 
     // Don't search while we're in the middle of loading a new file
     showSearchBar(false);
+    closeHugeFile();
 
-    // Don't let the syntax highlighter hinder us while setting the new content
+    // Don't let the syntax highlighter hinder us while setting the new content.
+    // Only the first screen is set here; the rest of a large document is
+    // appended by the editor in the background.
+    m_pendingLine = 0;
+    m_pendingScroll = -1;
     m_editor->clear();
     setSyntax(SyntaxTextEdit::nullSyntax());
-    m_editor->setPlainText(document);
+    m_editor->populatePlainText(loader->takeDocument());
     m_editor->document()->clearUndoRedoStacks();
 
     KSyntaxHighlighting::Definition definition;
@@ -916,16 +1180,97 @@ bool QTextPadWindow::loadDocumentFrom(const QString &filename, const QString &te
     populateRecentFiles();
 
     m_fileState = 0;
-    m_cachedModTime = QFileInfo(file).lastModified();
+    m_cachedModTime = loader->lastModified();
 
     m_undoStack->clear();
     m_undoStack->setClean();
     m_reloadAction->setEnabled(true);
     m_utfBOMAction->setChecked(detect.bomOffset() != 0);
     updateTitle();
+
+    // Saving will silently normalize these, so at least let the user know
+    if (detect.hasMixedLineEndings()) {
+        statusBar()->showMessage(tr("%1 has mixed line endings, which will be converted to %2 when saved")
+                                 .arg(QFileInfo(filename).fileName(), m_crlfLabel->text()));
+    }
     return true;
 }
 
+bool QTextPadWindow::openHugeFile(const QString &filename, const QString &codecName)
+{
+    TextCodec *codec = Q_NULLPTR;
+    if (!codecName.isEmpty()) {
+        codec = QTextPadCharsets::codecForName(codecName.toLatin1());
+        if (!codec) {
+            qDebug("Invalid manually-specified encoding: %s",
+                   codecName.toLocal8Bit().constData());
+        }
+    }
+
+    showSearchBar(false);
+    if (!m_hugeView->openFile(filename, codec)) {
+        qDebug("Not using the large file viewer: %s", qPrintable(m_hugeView->errorString()));
+        return false;
+    }
+
+    abortLoading();
+
+    // Release the memory held by the previous document
+    m_editor->clear();
+    m_editor->document()->clearUndoRedoStacks();
+    setSyntax(SyntaxTextEdit::nullSyntax());
+
+    syncHugeFileView();
+    m_editorStack->setCurrentWidget(m_hugeView);
+    m_hugeView->setFocus(Qt::OtherFocusReason);
+
+    setLineEndingMode(m_hugeView->lineEndings());
+    setEncoding(QString::fromLatin1(m_hugeView->textCodec()->name()));
+
+    const auto fileModes = QTextPadSettings::fileModes(filename);
+    if (fileModes.lineNum > 0)
+        m_hugeView->moveCursorTo(fileModes.lineNum);
+
+    setOpenFilename(filename);
+    QTextPadSettings::setFileModes(filename, m_textEncoding, QString(), fileModes.lineNum);
+    QTextPadSettings().addRecentFile(filename);
+    populateRecentFiles();
+
+    m_fileState = 0;
+    m_cachedModTime = QFileInfo(filename).lastModified();
+
+    m_undoStack->clear();
+    m_undoStack->setClean();
+    m_reloadAction->setEnabled(true);
+    m_utfBOMAction->setChecked(m_hugeView->bomOffset() != 0);
+    updateTitle();
+    updateCursorPosition();
+    return true;
+}
+
+void QTextPadWindow::closeHugeFile()
+{
+    if (!isHugeFileMode())
+        return;
+
+    m_hugeView->closeFile();
+    m_editorStack->setCurrentWidget(m_editor);
+    m_editor->setFocus(Qt::OtherFocusReason);
+}
+
+void QTextPadWindow::syncHugeFileView()
+{
+    m_hugeView->setFont(m_editor->font());
+    m_hugeView->setTheme(SyntaxTextEdit::syntaxRepo()->theme(m_editor->themeName()));
+    m_hugeView->setShowLineNumbers(m_editor->showLineNumbers());
+    m_hugeView->setTabWidth(m_editor->tabWidth());
+}
+
+bool QTextPadWindow::isHugeFileMode() const
+{
+    return m_editorStack->currentWidget() == m_hugeView;
+}
+
 bool QTextPadWindow::isDocumentModified() const
 {
     return !m_undoStack->isClean();
@@ -939,12 +1284,30 @@ bool QTextPadWindow::documentExists() const
 
 void QTextPadWindow::gotoLine(int line, int column)
 {
+    if (m_loader || (m_editor->isPopulating() && line > m_editor->document()->blockCount())) {
+        m_pendingLine = line;
+        m_pendingColumn = column;
+        return;
+    }
+    if (isHugeFileMode()) {
+        m_hugeView->moveCursorTo(line, column);
+        return;
+    }
     m_editor->moveCursorTo(line, column);
 }
 
+void QTextPadWindow::scrollEditorTo(int value)
+{
+    if (m_loader || m_editor->isPopulating()) {
+        m_pendingScroll = value;
+        return;
+    }
+    m_editor->verticalScrollBar()->setValue(value);
+}
+
 void QTextPadWindow::checkForModifications()
 {
-    if (m_openFilename.isEmpty() || (m_fileState & FS_OutOfDate) != 0)
+    if (m_openFilename.isEmpty() || (m_fileState & FS_OutOfDate) != 0 || m_loader || m_saver)
         return;
 
     QFileInfo info(m_openFilename);
@@ -983,10 +1346,15 @@ void QTextPadWindow::checkForModifications()
 
 bool QTextPadWindow::promptForSave()
 {
+    if (!waitForSave())
+        return false;
+
     if (documentExists()) {
         const QTextCursor cursor = m_editor->textCursor();
+        const int lineNum = isHugeFileMode() ? int(m_hugeView->cursorLine() + 1)
+                                             : cursor.blockNumber() + 1;
         QTextPadSettings::setFileModes(m_openFilename, m_textEncoding,
-                                       m_editor->syntaxName(), cursor.blockNumber() + 1);
+                                       m_editor->syntaxName(), lineNum);
     }
 
     if (isDocumentModified()) {
@@ -996,17 +1364,22 @@ bool QTextPadWindow::promptForSave()
         if (response == QMessageBox::Cancel)
             return false;
         else if (response == QMessageBox::Yes)
-            return saveDocument();
+            return saveDocument() && waitForSave();
     }
     return true;
 }
 
 bool QTextPadWindow::promptForDiscard()
 {
+    if (!waitForSave())
+        return false;
+
     if (documentExists()) {
         const QTextCursor cursor = m_editor->textCursor();
+        const int lineNum = isHugeFileMode() ? int(m_hugeView->cursorLine() + 1)
+                                             : cursor.blockNumber() + 1;
         QTextPadSettings::setFileModes(m_openFilename, m_textEncoding,
-                                       m_editor->syntaxName(), cursor.blockNumber() + 1);
+                                       m_editor->syntaxName(), lineNum);
     }
 
     if (isDocumentModified()) {
@@ -1023,12 +1396,14 @@ void QTextPadWindow::newDocument()
 {
     if (!promptForSave())
         return;
+    abortLoading();
     resetEditor();
     updateTitle();
 }
 
 void QTextPadWindow::resetEditor()
 {
+    closeHugeFile();
     m_editor->clear();
     m_editor->document()->clearUndoRedoStacks();
 
@@ -1053,14 +1428,7 @@ bool QTextPadWindow::saveDocument()
 {
     if (m_openFilename.isEmpty())
         return saveDocumentAs();
-    if (!saveDocumentTo(m_openFilename))
-        return false;
-
-    m_fileState = 0;
-    m_cachedModTime = QFileInfo(m_openFilename).lastModified();
-    m_undoStack->setClean();
-    updateTitle();
-    return true;
+    return startSave(m_openFilename, Save_CurrentDocument);
 }
 
 bool QTextPadWindow::saveDocumentAs()
@@ -1074,15 +1442,7 @@ bool QTextPadWindow::saveDocumentAs()
     QString path = QFileDialog::getSaveFileName(this, tr("Save File As"), startPath);
     if (path.isEmpty())
         return false;
-    if (!saveDocumentTo(path))
-        return false;
-
-    setOpenFilename(path);
-    m_fileState = 0;
-    m_cachedModTime = QFileInfo(path).lastModified();
-    m_undoStack->setClean();
-    updateTitle();
-    return true;
+    return startSave(path, Save_CurrentDocument);
 }
 
 bool QTextPadWindow::saveDocumentCopy()
@@ -1096,7 +1456,7 @@ bool QTextPadWindow::saveDocumentCopy()
     QString path = QFileDialog::getSaveFileName(this, tr("Save Copy As"), startPath);
     if (path.isEmpty())
         return false;
-    return saveDocumentTo(path);
+    return startSave(path, 0);
 }
 
 bool QTextPadWindow::loadDocument()
@@ -1130,8 +1490,31 @@ void QTextPadWindow::reloadDocumentEncoding(const QString &textEncoding)
     Q_ASSERT(documentExists());
 
     const QString oldEncoding = m_textEncoding;
-    if (!promptForDiscard() || !loadDocumentFrom(m_openFilename, textEncoding))
+    if (!promptForDiscard()) {
+        setEncoding(oldEncoding);
+        return;
+    }
+
+    // Trying another encoding shouldn't lose the user's place in the file
+    int line, column, scroll = -1;
+    if (isHugeFileMode()) {
+        line = static_cast<int>(m_hugeView->cursorLine()) + 1;
+        column = m_hugeView->cursorColumn() + 1;
+    } else {
+        const QTextCursor cursor = m_editor->textCursor();
+        line = cursor.blockNumber() + 1;
+        column = m_editor->textColumn(cursor.block().text(), cursor.positionInBlock()) + 1;
+        scroll = m_editor->verticalScrollBar()->value();
+    }
+
+    if (!startLoad(m_openFilename, textEncoding, Load_CachedData)) {
         setEncoding(oldEncoding);
+        return;
+    }
+
+    gotoLine(line, column);
+    if (scroll >= 0 && !isHugeFileMode())
+        scrollEditorTo(scroll);
 }
 
 void QTextPadWindow::printDocument()
@@ -1178,6 +1561,13 @@ void QTextPadWindow::editorContextMenu(const QPoint &pos)
 
 void QTextPadWindow::updateCursorPosition()
 {
+    if (isHugeFileMode()) {
+        m_positionLabel->setText(tr("Line %1, Col %2")
+                                 .arg(m_hugeView->cursorLine() + 1)
+                                 .arg(m_hugeView->cursorColumn() + 1));
+        return;
+    }
+
     const QTextCursor cursor = m_editor->textCursor();
     const int column = m_editor->textColumn(cursor.block().text(), cursor.positionInBlock());
     const int selectedChars = std::abs(cursor.selectionEnd() - cursor.selectionStart());
@@ -1205,6 +1595,8 @@ void QTextPadWindow::updateTitle()
         QFileInfo fi(m_openFilename);
         title += QStringLiteral(" [%1]").arg(fi.absolutePath());
     }
+    if (isHugeFileMode())
+        title += tr(" (Read Only)");
     if ((m_fileState & FS_OutOfDate) != 0)
         title += tr(" (Not Current)");
     else if ((m_fileState & FS_New) != 0)
@@ -1317,12 +1709,18 @@ void QTextPadWindow::changeEncoding(const QString &encoding)
         // Don't save changes in the undo stack if we are creating a new file
         setEncoding(encoding);
     } else {
+        QString message = tr("The current document encoding is '%1'.  Would you like to:<ul>"
+                             "<li><b>Reload</b> the existing file in the '%2' encoding, or</li>"
+                             "<li><b>Convert</b> the current document's encoding to '%2'?</li></ul>")
+                             .arg(m_textEncoding).arg(encoding);
+        auto newCodec = QTextPadCharsets::codecForName(encoding.toLatin1());
+        if (newCodec && !m_encodingTracker->canEncodeWith(newCodec)) {
+            message += tr("<p><b>Warning:</b> The document contains characters that can't "
+                          "be represented in '%1', which will be lost if it is converted.</p>")
+                          .arg(encoding);
+        }
         QMessageBox mbQuestion(QMessageBox::Question, tr("Change Document Encoding"),
-               tr("The current document encoding is '%1'.  Would you like to:<ul>"
-                  "<li><b>Reload</b> the existing file in the '%2' encoding, or</li>"
-                  "<li><b>Convert</b> the current document's encoding to '%2'?</li></ul>")
-                  .arg(m_textEncoding).arg(encoding),
-               QMessageBox::Cancel, this);
+                               message, QMessageBox::Cancel, this);
         auto reloadButton = mbQuestion.addButton(tr("&Reload"), QMessageBox::AcceptRole);
         auto convertButton = mbQuestion.addButton(tr("&Convert"), QMessageBox::AcceptRole);
 
@@ -1379,10 +1777,24 @@ void QTextPadWindow::promptLongLineWidth()
     }
 }
 
+void QTextPadWindow::promptHugeFileThreshold()
+{
+    QTextPadSettings settings;
+    bool ok;
+    auto threshold = QInputDialog::getInt(this, tr("Large File Viewer"),
+            tr("Open files of at least this size (MiB) in the read-only viewer.\n"
+               "Set to 0 to always use the editor."),
+            settings.hugeFileThreshold(), 0, std::numeric_limits<int>::max() / 1024, 1, &ok);
+    if (ok)
+        settings.setHugeFileThreshold(threshold);
+}
+
 void QTextPadWindow::navigateToLine()
 {
     const QTextCursor cursor = m_editor->textCursor();
-    const QString curLine = QString::number(cursor.block().blockNumber() + 1);
+    const QString curLine = isHugeFileMode()
+                          ? QString::number(m_hugeView->cursorLine() + 1)
+                          : QString::number(cursor.block().blockNumber() + 1);
     QInputDialog dialog(this);
     dialog.setWindowTitle(tr("Go to Line"));
     dialog.setWindowIcon(ICON("go-jump"));
@@ -1543,7 +1955,7 @@ void QTextPadWindow::resizeEvent(QResizeEvent *event)
         QMainWindow::resizeEvent(event);
 
     // Move the search widget to the upper-right corner
-    const QPoint editorPos = m_editor->pos();
+    const QPoint editorPos = m_editorStack->pos();
     QSize searchSize = m_searchWidget->sizeHint();
     m_searchWidget->resize(searchSize);
     m_searchWidget->move(editorPos.x() + m_editor->viewport()->width() - searchSize.width() - 16,
@@ -1562,6 +1974,7 @@ void QTextPadWindow::closeEvent(QCloseEvent *event)
         event->ignore();
         return;
     }
+    abortLoading();
 
     if ((windowState() & (Qt::WindowMaximized | Qt::WindowFullScreen)) == 0) {
         QTextPadSettings settings;
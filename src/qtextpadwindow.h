@@ -20,14 +20,22 @@
 #include <QMainWindow>
 #include <QDateTime>
 #include <QLocale>
+#include <KSyntaxHighlighting/Definition>
 
 #include "filetypeinfo.h"
 
 class SyntaxTextEdit;
 class SearchWidget;
 class ActivationLabel;
+class DocumentLoader;
+class DocumentSaver;
+class HugeFileView;
+class EncodingTracker;
 
 class QToolButton;
+class QProgressBar;
+class QLabel;
+class QStackedWidget;
 class QMenu;
 class QActionGroup;
 class QUndoStack;
@@ -36,7 +44,6 @@ class QFileSystemWatcher;
 
 namespace KSyntaxHighlighting
 {
-    class Definition;
     class Theme;
 }
 
@@ -48,6 +55,8 @@ public:
     explicit QTextPadWindow(QWidget *parent = Q_NULLPTR);
 
     SyntaxTextEdit *editor() { return m_editor; }
+    HugeFileView *hugeFileView() { return m_hugeView; }
+    bool isHugeFileMode() const;
 
     void setSyntax(const KSyntaxHighlighting::Definition &syntax);
     void setEditorTheme(const KSyntaxHighlighting::Theme &theme);
@@ -65,16 +74,20 @@ public:
     void setLineEndingMode(FileTypeInfo::LineEndingType mode);
     FileTypeInfo::LineEndingType lineEndingMode() const { return m_lineEndingMode; }
 
-    bool saveDocumentTo(const QString &filename);
     bool loadDocumentFrom(const QString &filename,
                           const QString &textEncoding = QString());
     bool isDocumentModified() const;
     bool documentExists() const;
+    QString openFilename() const { return m_openFilename; }
+    bool isLoading() const { return m_loader != Q_NULLPTR; }
+    bool isSaving() const { return m_saver != Q_NULLPTR; }
+    bool waitForSave();
 
     void gotoLine(int line, int column = 0);
 
 public slots:
     void checkForModifications();
+    void cancelLoading();
     bool promptForSave();
     bool promptForDiscard();
     void newDocument();
@@ -96,6 +109,7 @@ public slots:
     void chooseEditorFont();
     void promptIndentSettings();
     void promptLongLineWidth();
+    void promptHugeFileThreshold();
     void navigateToLine();
     void toggleFilePath(bool show);
 
@@ -128,8 +142,12 @@ private:
     };
 
     SyntaxTextEdit *m_editor;
+    HugeFileView *m_hugeView;
+    QStackedWidget *m_editorStack;
     SearchWidget *m_searchWidget;
     QString m_textEncoding;
+    EncodingTracker *m_encodingTracker;
+    void updateEncodingStatus();
 
     QString m_openFilename;
     unsigned int m_fileState;
@@ -137,6 +155,39 @@ private:
     QDateTime m_cachedModTime;
     void setOpenFilename(const QString &filename);
 
+    // Background loading of large files
+    enum LoadFlags
+    {
+        Load_CachedData = 0x01,
+    };
+    DocumentLoader *m_loader;
+    QProgressBar *m_loadProgress;
+    QToolButton *m_cancelLoadButton;
+    int m_pendingLine, m_pendingColumn;
+    int m_pendingScroll;
+    KSyntaxHighlighting::Definition m_pendingSyntax;
+    bool startLoad(const QString &filename, const QString &textEncoding, unsigned int flags);
+    bool finishLoading(DocumentLoader *loader);
+    void scrollEditorTo(int value);
+
+    // Background saving
+    enum SaveFlags
+    {
+        Save_CurrentDocument = 0x01,
+    };
+    DocumentSaver *m_saver;
+    bool m_savingCurrent;
+    QLabel *m_saveIndicator;
+    bool startSave(const QString &filename, unsigned int flags);
+    bool finishSaving(DocumentSaver *saver, bool currentDocument);
+    void saverFinished();
+
+    bool openHugeFile(const QString &filename, const QString &codecName);
+    void closeHugeFile();
+    void syncHugeFileView();
+    void loaderFinished();
+    void abortLoading();
+
     QToolBar *m_toolBar;
     QMenu *m_recentFiles;
     QMenu *m_themeMenu;
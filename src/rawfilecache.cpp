@@ -0,0 +1,106 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "rawfilecache.h"
+
+#include <QList>
+#include <QMutex>
+
+#define RAW_CACHE_LIMIT     (64*1024*1024)  // 64 MiB
+
+namespace
+{
+    struct CacheEntry
+    {
+        QString filename;
+        QDateTime lastModified;
+        QByteArray data;
+    };
+
+    // Most recently used first
+    struct FileCache
+    {
+        QList<CacheEntry> m_entries;
+        qint64 m_totalSize = 0;
+        QMutex m_lock;
+
+        void removeAt(int index)
+        {
+            m_totalSize -= m_entries.at(index).data.size();
+            m_entries.removeAt(index);
+        }
+
+        int indexOf(const QString &filename) const
+        {
+            for (int i = 0; i < m_entries.size(); ++i) {
+                if (m_entries.at(i).filename == filename)
+                    return i;
+            }
+            return -1;
+        }
+    };
+}
+
+static FileCache s_cache;
+
+bool RawFileCache::canCache(qint64 size)
+{
+    return size > 0 && size <= RAW_CACHE_LIMIT;
+}
+
+QByteArray RawFileCache::find(const QString &filename, const QDateTime &lastModified)
+{
+    QMutexLocker locker(&s_cache.m_lock);
+    const int index = s_cache.indexOf(filename);
+    if (index < 0)
+        return QByteArray();
+    if (s_cache.m_entries.at(index).lastModified != lastModified) {
+        // The file has changed since it was cached
+        s_cache.removeAt(index);
+        return QByteArray();
+    }
+
+    s_cache.m_entries.move(index, 0);
+    return s_cache.m_entries.first().data;
+}
+
+void RawFileCache::insert(const QString &filename, const QDateTime &lastModified,
+                          const QByteArray &data)
+{
+    if (!canCache(data.size()))
+        return;
+
+    QMutexLocker locker(&s_cache.m_lock);
+    const int index = s_cache.indexOf(filename);
+    if (index >= 0)
+        s_cache.removeAt(index);
+
+    while (!s_cache.m_entries.isEmpty()
+            && s_cache.m_totalSize + data.size() > RAW_CACHE_LIMIT)
+        s_cache.removeAt(s_cache.m_entries.size() - 1);
+
+    s_cache.m_entries.prepend(CacheEntry { filename, lastModified, data });
+    s_cache.m_totalSize += data.size();
+}
+
+void RawFileCache::remove(const QString &filename)
+{
+    QMutexLocker locker(&s_cache.m_lock);
+    const int index = s_cache.indexOf(filename);
+    if (index >= 0)
+        s_cache.removeAt(index);
+}
@@ -0,0 +1,42 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTEXTPAD_RAWFILECACHE_H
+#define QTEXTPAD_RAWFILECACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+
+// Keeps the undecoded contents of recently loaded files, so a file can be
+// decoded again (e.g. with a different encoding) without reading it from
+// disk.  The cache is shared by all windows and threads, and holds at most
+// RAW_CACHE_LIMIT bytes; the least recently used files are dropped first.
+namespace RawFileCache
+{
+    bool canCache(qint64 size);
+
+    // Returns a null array unless the cached copy was read from the file as
+    // of lastModified.
+    QByteArray find(const QString &filename, const QDateTime &lastModified);
+
+    void insert(const QString &filename, const QDateTime &lastModified,
+                const QByteArray &data);
+    void remove(const QString &filename);
+}
+
+#endif // QTEXTPAD_RAWFILECACHE_H
@@ -0,0 +1,90 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replacetemplate.h"
+
+#include <QRegularExpressionMatch>
+
+static inline bool isAsciiDigit(QChar ch)
+{
+    return ch.unicode() >= '0' && ch.unicode() <= '9';
+}
+
+ReplaceTemplate::ReplaceTemplate(const QString &text)
+{
+    m_literals.reserve(text.size());
+
+    // Adjacent pieces of literal text (including backslashes that aren't
+    // group references) are merged into a single op.
+    auto addLiteral = [this, &text](int start, int length) {
+        if (length == 0)
+            return;
+        if (!m_ops.empty() && m_ops.back().group < 0)
+            m_ops.back().length += length;
+        else
+            m_ops.push_back(Op { -1, static_cast<int>(m_literals.size()), length });
+        m_literals.append(text.constData() + start, length);
+    };
+
+    int start = 0;
+    for ( ;; ) {
+        const int pos = text.indexOf(QLatin1Char('\\'), start);
+        if (pos < 0 || pos + 1 >= text.size())
+            break;
+
+        addLiteral(start, pos - start);
+        if (isAsciiDigit(text.at(pos + 1))) {
+            // We support up to 99 replacements...
+            int group = text.at(pos + 1).unicode() - '0';
+            start = pos + 2;
+            if (start < text.size() && isAsciiDigit(text.at(start))) {
+                group = (group * 10) + (text.at(start).unicode() - '0');
+                ++start;
+            }
+            m_ops.push_back(Op { group, 0, 0 });
+        } else {
+            addLiteral(pos, 2);
+            start = pos + 2;
+        }
+    }
+    addLiteral(start, text.size() - start);
+}
+
+int ReplaceTemplate::replacementLength(const QRegularExpressionMatch &match) const
+{
+    int length = 0;
+    for (const Op &op : m_ops) {
+        if (op.group < 0)
+            length += op.length;
+        else
+            length += match.capturedLength(op.group);
+    }
+    return length;
+}
+
+void ReplaceTemplate::apply(const QRegularExpressionMatch &match, QString *output) const
+{
+    for (const Op &op : m_ops) {
+        if (op.group < 0) {
+            output->append(m_literals.constData() + op.start, op.length);
+        } else {
+            // Groups that don't exist or didn't participate in the match
+            // give an empty view
+            const QStringView captured = match.capturedView(op.group);
+            output->append(captured.data(), static_cast<int>(captured.size()));
+        }
+    }
+}
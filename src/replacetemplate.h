@@ -0,0 +1,63 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QTEXTPAD_REPLACETEMPLATE_H
+#define QTEXTPAD_REPLACETEMPLATE_H
+
+#include <QString>
+#include <vector>
+
+class QRegularExpressionMatch;
+
+// A regex replacement string, parsed once into the literal text and group
+// references it's made of.  Replace All applies the same template to every
+// match, so this keeps the parsing out of the per-match work.
+//
+// \0 through \99 are replaced with the corresponding captured group (or
+// nothing if there's no such group); any other backslash is copied as-is.
+// Escape sequences should already have been translated.
+class ReplaceTemplate
+{
+public:
+    explicit ReplaceTemplate(const QString &text);
+
+    // Number of characters the replacement for match will take
+    int replacementLength(const QRegularExpressionMatch &match) const;
+
+    // Appends the replacement for match to output
+    void apply(const QRegularExpressionMatch &match, QString *output) const;
+
+    QString apply(const QRegularExpressionMatch &match) const
+    {
+        QString result;
+        result.reserve(replacementLength(match));
+        apply(match, &result);
+        return result;
+    }
+
+private:
+    struct Op
+    {
+        int group;      // Group number, or -1 for a literal
+        int start;      // Literal text within m_literals
+        int length;
+    };
+
+    QString m_literals;
+    std::vector<Op> m_ops;
+};
+
+#endif // QTEXTPAD_REPLACETEMPLATE_H
@@ -28,11 +28,18 @@
 #include <QGridLayout>
 #include <QCompleter>
 #include <QMessageBox>
+#include <QLocale>
 #include <QPainter>
 #include <QStringView>
+#include <QTextDocument>
+#include <QElapsedTimer>
+
+#include <limits>
 
 #include "qtextpadwindow.h"
+#include "hugefileview.h"
 #include "appsettings.h"
+#include "replacetemplate.h"
 
 static SearchDialog *s_instance = Q_NULLPTR;
 
@@ -47,7 +54,7 @@ static inline QString &string_appendView(QString &str, QStringView view)
 }
 
 SearchWidget::SearchWidget(QTextPadWindow *parent)
-    : QWidget(parent), m_editor(parent->editor())
+    : QWidget(parent), m_window(parent), m_editor(parent->editor())
 {
     auto tbMenu = new QToolButton(this);
     tbMenu->setAutoRaise(true);
@@ -79,6 +86,9 @@ SearchWidget::SearchWidget(QTextPadWindow *parent)
     m_searchText->setClearButtonEnabled(true);
     setFocusProxy(m_searchText);
 
+    m_matchCount = new QLabel(this);
+    m_matchCount->setEnabled(false);
+
     auto tbNext = new QToolButton(this);
     tbNext->setAutoRaise(true);
     tbNext->setIconSize(QSize(16, 16));
@@ -96,6 +106,7 @@ SearchWidget::SearchWidget(QTextPadWindow *parent)
     layout->setSpacing(5);
     layout->addWidget(tbMenu);
     layout->addWidget(m_searchText);
+    layout->addWidget(m_matchCount);
     layout->addWidget(tbNext);
     layout->addWidget(tbPrev);
     setLayout(layout);
@@ -104,11 +115,16 @@ SearchWidget::SearchWidget(QTextPadWindow *parent)
         m_searchParams.searchText = m_escapes->isChecked()
                                   ? SearchDialog::translateEscapes(text)
                                   : text;
-        m_editor->setLiveSearch(m_searchParams);
+        updateLiveSearch();
     });
     connect(m_searchText, &QLineEdit::returnPressed, this, [this] { searchNext(false); });
     connect(tbNext, &QToolButton::clicked, this, [this] { searchNext(false); });
     connect(tbPrev, &QToolButton::clicked, this, [this] { searchNext(true); });
+
+    connect(m_editor, &SyntaxTextEdit::liveSearchMatchesChanged,
+            this, &SearchWidget::updateMatchCount);
+    connect(m_editor, &SyntaxTextEdit::cursorPositionChanged,
+            this, &SearchWidget::updateMatchCount);
 }
 
 void SearchWidget::setSearchText(const QString &text)
@@ -131,7 +147,7 @@ void SearchWidget::activate()
 
     setFocus(Qt::OtherFocusReason);
     m_searchText->selectAll();
-    m_editor->setLiveSearch(m_searchParams);
+    updateLiveSearch();
 }
 
 void SearchWidget::searchNext(bool reverse)
@@ -144,6 +160,18 @@ void SearchWidget::searchNext(bool reverse)
     if (m_searchParams.searchText.isEmpty())
         return;
 
+    const QString error = SyntaxTextEdit::searchError(m_searchParams);
+    if (!error.isEmpty()) {
+        QMessageBox::critical(this, QString(), tr("Invalid regular expression: %1").arg(error));
+        return;
+    }
+
+    if (m_window->isHugeFileMode()) {
+        if (!m_window->hugeFileView()->find(m_searchParams, reverse, m_wrapSearch->isChecked()))
+            QMessageBox::information(this, QString(), tr("The specified text was not found"));
+        return;
+    }
+
     auto searchCursor = m_editor->textSearch(m_editor->textCursor(),
                                              m_searchParams, false, reverse);
     if (searchCursor.isNull() && m_wrapSearch->isChecked()) {
@@ -159,6 +187,59 @@ void SearchWidget::searchNext(bool reverse)
         m_editor->setTextCursor(searchCursor);
 }
 
+void SearchWidget::updateLiveSearch()
+{
+    // Flag a bad pattern right away instead of silently finding nothing
+    const QString error = SyntaxTextEdit::searchError(m_searchParams);
+    QPalette pal = m_searchText->palette();
+    if (error.isEmpty()) {
+        pal.setColor(QPalette::Base, palette().color(QPalette::Base));
+        m_searchText->setToolTip(QString());
+    } else {
+        const QColor base = palette().color(QPalette::Base);
+        pal.setColor(QPalette::Base, base.lightness() < 128 ? QColor(0x60, 0x20, 0x20)
+                                                            : QColor(0xff, 0xc0, 0xc0));
+        m_searchText->setToolTip(tr("Invalid regular expression: %1").arg(error));
+    }
+    m_searchText->setPalette(pal);
+
+    if (m_window->isHugeFileMode())
+        m_window->hugeFileView()->setLiveSearch(m_searchParams);
+    else
+        m_editor->setLiveSearch(m_searchParams);
+    updateMatchCount();
+}
+
+void SearchWidget::updateMatchCount()
+{
+    // The huge file view doesn't count its matches
+    if (m_searchParams.searchText.isEmpty() || m_window->isHugeFileMode()) {
+        m_matchCount->clear();
+        return;
+    }
+
+    const QString error = m_editor->liveSearchError();
+    if (!error.isEmpty()) {
+        m_matchCount->setText(error);
+        return;
+    }
+
+    const int count = m_editor->liveSearchMatchCount();
+    if (count < 0) {
+        m_matchCount->setText(tr("Searching..."));
+        return;
+    }
+
+    const int index = m_editor->liveSearchMatchIndex(m_editor->textCursor());
+    const QLocale locale;
+    if (index >= 0) {
+        m_matchCount->setText(tr("Match %1 of %2").arg(locale.toString(index + 1),
+                                                       locale.toString(count)));
+    } else {
+        m_matchCount->setText(tr("%Ln match(es)", Q_NULLPTR, count));
+    }
+}
+
 void SearchWidget::paintEvent(QPaintEvent *)
 {
     QPainter painter(this);
@@ -197,27 +278,9 @@ void SearchWidget::updateSettings()
     settings.setSearchEscapes(m_escapes->isChecked());
     settings.setSearchWrap(m_wrapSearch->isChecked());
 
-    m_editor->setLiveSearch(m_searchParams);
+    updateLiveSearch();
 }
 
-/* Just sets some more sane defaults for QComboBox:
- * - Don't auto-insert items (we handle that manually)
- * - Disable the completer, since it insists on changing the a typed
- *   item to match another item in the list that differs only in case.
- */
-class SearchComboBox : public QComboBox
-{
-public:
-    explicit SearchComboBox(QWidget *parent)
-        : QComboBox(parent)
-    {
-        setEditable(true);
-        setInsertPolicy(QComboBox::NoInsert);
-        setDuplicatesEnabled(true);
-        setCompleter(Q_NULLPTR);
-    }
-};
-
 SearchDialog::SearchDialog(QWidget *parent)
     : QDialog(parent), m_editor()
 {
@@ -467,37 +530,6 @@ QString SearchDialog::translateEscapes(const QString &text)
     return result;
 }
 
-QString SearchDialog::regexReplace(const QString &text,
-                                   const QRegularExpressionMatch &regexMatch)
-{
-    QString result;
-    result.reserve(text.size());
-    int start = 0;
-    for ( ;; ) {
-        int pos = text.indexOf(QLatin1Char('\\'), start);
-        if (pos < 0 || pos + 1 >= text.size())
-            break;
-
-        string_appendView(result, QStringView(text).mid(start, pos - start));
-        QChar next = text.at(pos + 1);
-        if (next.unicode() >= '0' && next.unicode() <= '9') {
-            // We support up to 99 replacements...
-            QByteArray number = QStringView(text).mid(pos + 1, 2).toLatin1();
-            char *end;
-            ulong ref = strtoul(number.constData(), &end, 10);
-            result.append(regexMatch.captured(ref));
-            start = pos + 1 + (end - number.constData());
-        } else {
-            result.append(QLatin1Char('\\'));
-            result.append(next);
-            start = pos + 2;
-        }
-    }
-
-    string_appendView(result, QStringView(text).mid(start));
-    return result;
-}
-
 void SearchDialog::syncSearchSettings(bool saveRecent)
 {
     QTextPadSettings settings;
@@ -532,12 +564,25 @@ void SearchDialog::syncSearchSettings(bool saveRecent)
     settings.setSearchWrap(m_wrapSearch->isChecked());
 }
 
+bool SearchDialog::checkSearchPattern()
+{
+    const QString error = SyntaxTextEdit::searchError(m_searchParams);
+    if (error.isEmpty())
+        return true;
+
+    QMessageBox::critical(this, QString(), tr("Invalid regular expression: %1").arg(error));
+    m_searchText->setFocus(Qt::OtherFocusReason);
+    return false;
+}
+
 QTextCursor SearchDialog::searchNext(bool reverse)
 {
     Q_ASSERT(m_editor);
 
     if (m_searchParams.searchText.isEmpty())
         return QTextCursor();
+    if (!checkSearchPattern())
+        return QTextCursor();
 
     auto searchCursor = m_editor->textSearch(m_editor->textCursor(),
                                              m_searchParams, false, reverse,
@@ -589,7 +634,7 @@ void SearchDialog::replaceCurrent()
     m_replaceCursor.beginEditBlock();
     m_replaceCursor.removeSelectedText();
     if (m_regex->isChecked())
-        m_replaceCursor.insertText(regexReplace(replaceText, m_regexMatch));
+        m_replaceCursor.insertText(ReplaceTemplate(replaceText).apply(m_regexMatch));
     else
         m_replaceCursor.insertText(replaceText);
     m_replaceCursor.endEditBlock();
@@ -605,19 +650,38 @@ void SearchDialog::performReplaceAll(ReplaceAllMode mode)
     const QString searchText = m_searchText->currentText();
     if (searchText.isEmpty())
         return;
+    if (!checkSearchPattern())
+        return;
 
-    auto searchCursor = m_editor->textCursor();
-    if (mode == InSelection)
-        searchCursor.setPosition(m_editor->textCursor().selectionStart());
-    else
-        searchCursor.movePosition(QTextCursor::Start);
-    searchCursor = m_editor->textSearch(searchCursor, m_searchParams, true,
-                                        false, &m_regexMatch);
-    if (searchCursor.isNull()) {
-        QMessageBox::information(this, QString(), tr("The specified text was not found"));
+    QElapsedTimer timer;
+    timer.start();
+
+    m_editor->finishPopulation();
+    QTextDocument *document = m_editor->document();
+    const QString text = document->toRawText();
+    int rangeStart = 0;
+    int rangeEnd = text.size();
+    if (mode == InSelection) {
+        rangeStart = m_editor->textCursor().selectionStart();
+        rangeEnd = m_editor->textCursor().selectionEnd();
+    }
+
+    // Find every match in a snapshot of the text first, and then replace
+    // them all with a single edit.  Editing the document once per match
+    // means updating the layout, highlighting and every cursor each time.
+    std::vector<SyntaxTextEdit::SearchMatch> matches;
+    std::vector<QRegularExpressionMatch> regexMatches;
+    if (!m_editor->findAllMatches(m_searchParams, rangeStart, rangeEnd, &matches,
+                                  m_searchParams.regex ? &regexMatches : Q_NULLPTR)) {
+        QMessageBox::critical(this, QString(),
+                              tr("The search pattern is too complex.  No text was replaced."));
         return;
-    } else if (mode == InSelection && searchCursor.selectionEnd() > m_editor->textCursor().selectionEnd()) {
-        QMessageBox::information(this, QString(), tr("The specified text was not found in the selection"));
+    }
+    if (matches.empty()) {
+        if (mode == InSelection)
+            QMessageBox::information(this, QString(), tr("The specified text was not found in the selection"));
+        else
+            QMessageBox::information(this, QString(), tr("The specified text was not found"));
         return;
     }
 
@@ -625,23 +689,49 @@ void SearchDialog::performReplaceAll(ReplaceAllMode mode)
     if (m_escapes->isChecked())
         replaceText = translateEscapes(replaceText);
 
-    searchCursor.beginEditBlock();
-    auto replaceCursor = searchCursor;
-    int replacements = 0;
-    while (!replaceCursor.isNull()) {
-        if (mode == InSelection && replaceCursor.selectionEnd() > m_editor->textCursor().selectionEnd())
-            break;
-
-        replaceCursor.removeSelectedText();
-        if (m_regex->isChecked())
-            replaceCursor.insertText(regexReplace(replaceText, m_regexMatch));
+    // Only the text from the first match to the end of the last one changes
+    const int editStart = matches.front().start;
+    const int editEnd = matches.back().start + matches.back().length;
+
+    // The replacement is parsed once, and the size of the result is worked
+    // out up front so the whole thing is built in a single allocation.
+    const ReplaceTemplate replaceTemplate(replaceText);
+    qint64 replacedSize = editEnd - editStart;
+    for (size_t i = 0; i < matches.size(); ++i) {
+        replacedSize -= matches[i].length;
+        if (m_searchParams.regex)
+            replacedSize += replaceTemplate.replacementLength(regexMatches[i]);
         else
-            replaceCursor.insertText(replaceText);
-        replaceCursor = m_editor->textSearch(replaceCursor, m_searchParams,
-                                             false, false, &m_regexMatch);
-        ++replacements;
+            replacedSize += replaceText.size();
+    }
+    if (replacedSize > std::numeric_limits<int>::max()) {
+        QMessageBox::critical(this, QString(),
+                              tr("The replaced text would be too large.  No text was replaced."));
+        return;
     }
-    searchCursor.endEditBlock();
 
-    QMessageBox::information(this, QString(), tr("Successfully replaced %1 matches").arg(replacements));
+    QString replaced;
+    replaced.reserve(static_cast<int>(replacedSize));
+    int pos = editStart;
+    for (size_t i = 0; i < matches.size(); ++i) {
+        string_appendView(replaced, QStringView(text).mid(pos, matches[i].start - pos));
+        if (m_searchParams.regex)
+            replaceTemplate.apply(regexMatches[i], &replaced);
+        else
+            replaced.append(replaceText);
+        pos = matches[i].start + matches[i].length;
+    }
+    Q_ASSERT(replaced.size() == replacedSize);
+
+    QTextCursor replaceCursor(document);
+    replaceCursor.setPosition(editStart);
+    replaceCursor.setPosition(editEnd, QTextCursor::KeepAnchor);
+    replaceCursor.beginEditBlock();
+    replaceCursor.insertText(replaced);
+    replaceCursor.endEditBlock();
+
+    QMessageBox::information(this, QString(),
+                             tr("Successfully replaced %1 matches in %2 seconds")
+                             .arg(matches.size())
+                             .arg(timer.elapsed() / 1000.0, 0, 'f', 2));
 }
@@ -18,20 +18,39 @@
 #define QTEXTPAD_SEARCHDIALOG_H
 
 #include <QDialog>
+#include <QComboBox>
 #include <QList>
 #include <QTextCursor>
 #include <QRegularExpressionMatch>
 
 #include "syntaxtextedit.h"
 
+class QLabel;
 class QLineEdit;
-class QComboBox;
 class QCheckBox;
 class QPushButton;
 class QTextCursor;
 class SyntaxTextEdit;
 class QTextPadWindow;
 
+/* Just sets some more sane defaults for QComboBox:
+ * - Don't auto-insert items (we handle that manually)
+ * - Disable the completer, since it insists on changing the a typed
+ *   item to match another item in the list that differs only in case.
+ */
+class SearchComboBox : public QComboBox
+{
+public:
+    explicit SearchComboBox(QWidget *parent)
+        : QComboBox(parent)
+    {
+        setEditable(true);
+        setInsertPolicy(QComboBox::NoInsert);
+        setDuplicatesEnabled(true);
+        setCompleter(Q_NULLPTR);
+    }
+};
+
 class SearchWidget : public QWidget
 {
     Q_OBJECT
@@ -57,15 +76,20 @@ protected:
 
 private slots:
     void updateSettings();
+    void updateMatchCount();
 
 private:
+    void updateLiveSearch();
+
     QLineEdit *m_searchText;
+    QLabel *m_matchCount;
     QAction *m_caseSensitive;
     QAction *m_wholeWord;
     QAction *m_regex;
     QAction *m_escapes;
     QAction *m_wrapSearch;
 
+    QTextPadWindow *m_window;
     SyntaxTextEdit *m_editor;
     SyntaxTextEdit::SearchParams m_searchParams;
 };
@@ -80,8 +104,6 @@ public:
     ~SearchDialog() Q_DECL_OVERRIDE;
 
     static QString translateEscapes(const QString &text);
-    static QString regexReplace(const QString &text,
-                                const QRegularExpressionMatch &regexMatch);
 
 public slots:
     QTextCursor searchNext(bool reverse);
@@ -95,6 +117,7 @@ private:
     explicit SearchDialog(QWidget *parent);
 
     void syncSearchSettings(bool saveRecent);
+    bool checkSearchPattern();
 
     enum ReplaceAllMode { WholeDocument, InSelection };
     void performReplaceAll(ReplaceAllMode mode);
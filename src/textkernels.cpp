@@ -0,0 +1,834 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "textkernels.h"
+
+#include <cstdint>
+
+#include "simdsupport.h"
+
+#define REPLACEMENT_CHAR    0xFFFD
+#define SUBSTITUTE_BYTE     0x1A
+
+typedef unsigned char uchar;
+
+#ifdef SIMDSUPPORT_AVX2
+static const bool s_hasAvx2 = SimdSupport::detectAvx2();
+
+TARGET_AVX2
+static size_t asciiPrefixAvx2(const uchar *data, size_t size)
+{
+    size_t pos = 0;
+    for ( ; pos + 32 <= size; pos += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(chunk));
+        if (mask)
+            return pos + SimdSupport::countTrailingZeros(mask);
+    }
+    return pos;
+}
+
+// Widens 32 bytes at a time, stopping at the first block that contains a
+// non-ASCII byte.  The whole block is still written out, which is safe as
+// long as the output has at least as much room as the input.
+TARGET_AVX2
+static size_t widenAsciiAvx2(const uchar *data, size_t size, char16_t *output)
+{
+    size_t pos = 0;
+    for ( ; pos + 32 <= size; pos += 32) {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos + 16));
+        auto out = reinterpret_cast<__m256i *>(output + pos);
+        _mm256_storeu_si256(out, _mm256_cvtepu8_epi16(lo));
+        _mm256_storeu_si256(out + 1, _mm256_cvtepu8_epi16(hi));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(lo, hi)));
+        if (mask) {
+            const unsigned exact = static_cast<unsigned>(_mm_movemask_epi8(lo))
+                                 | (static_cast<unsigned>(_mm_movemask_epi8(hi)) << 16);
+            return pos + SimdSupport::countTrailingZeros(exact);
+        }
+    }
+    return pos;
+}
+#endif // SIMDSUPPORT_AVX2
+
+// Returns the number of leading ASCII bytes, writing them (and possibly a
+// few more) to the output as UTF-16.
+static inline size_t widenAscii(const uchar *data, size_t size, char16_t *output)
+{
+    size_t pos = 0;
+#ifdef SIMDSUPPORT_AVX2
+    if (size >= 64 && s_hasAvx2) {
+        pos = widenAsciiAvx2(data, size, output);
+        if (pos + 32 <= size)
+            return pos;
+    }
+#endif
+#ifdef SIMDSUPPORT_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; pos + 16 <= size; pos += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        auto out = reinterpret_cast<__m128i *>(output + pos);
+        _mm_storeu_si128(out, _mm_unpacklo_epi8(chunk, zero));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(chunk, zero));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(chunk));
+        if (mask)
+            return pos + SimdSupport::countTrailingZeros(mask);
+    }
+#endif
+    for ( ; pos < size; ++pos) {
+        if (data[pos] >= 0x80)
+            break;
+        output[pos] = data[pos];
+    }
+    return pos;
+}
+
+size_t TextKernels::asciiPrefixLength(const char *data, size_t size)
+{
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    size_t pos = 0;
+#ifdef SIMDSUPPORT_AVX2
+    if (size >= 64 && s_hasAvx2) {
+        pos = asciiPrefixAvx2(bytes, size);
+        if (pos + 32 <= size)
+            return pos;
+    }
+#endif
+#ifdef SIMDSUPPORT_SSE2
+    for ( ; pos + 16 <= size; pos += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + pos));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(chunk));
+        if (mask)
+            return pos + SimdSupport::countTrailingZeros(mask);
+    }
+#endif
+    while (pos < size && bytes[pos] < 0x80)
+        ++pos;
+    return pos;
+}
+
+// Scans one multi-byte UTF-8 sequence starting at a non-ASCII lead byte.
+// Returns the number of bytes in the sequence if it is well-formed, and
+// stores the code point.  Otherwise, returns the negated length of the
+// maximal subpart to be replaced by a single U+FFFD (see "U+FFFD Substitution
+// of Maximal Subparts" in chapter 3 of the Unicode standard).  If the input
+// ends in the middle of a valid sequence, *truncated is set.
+static inline int scanUtf8Sequence(const uchar *data, const uchar *end,
+                                   uint32_t *codePoint, bool *truncated)
+{
+    const uchar lead = data[0];
+    int trailCount;
+    uchar lowerBound = 0x80, upperBound = 0xBF;
+    uint32_t ch;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        trailCount = 1;
+        ch = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        trailCount = 2;
+        ch = lead & 0x0F;
+        if (lead == 0xE0)
+            lowerBound = 0xA0;      // Overlong
+        else if (lead == 0xED)
+            upperBound = 0x9F;      // Surrogates
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        trailCount = 3;
+        ch = lead & 0x07;
+        if (lead == 0xF0)
+            lowerBound = 0x90;      // Overlong
+        else if (lead == 0xF4)
+            upperBound = 0x8F;      // Above U+10FFFF
+    } else {
+        return -1;
+    }
+
+    for (int i = 1; i <= trailCount; ++i) {
+        if (data + i >= end) {
+            *truncated = true;
+            return -i;
+        }
+        const uchar trail = data[i];
+        if (trail < lowerBound || trail > upperBound)
+            return -i;
+        ch = (ch << 6) | (trail & 0x3F);
+        lowerBound = 0x80;
+        upperBound = 0xBF;
+    }
+    *codePoint = ch;
+    return trailCount + 1;
+}
+
+size_t TextKernels::utf8ToUtf16(const char *data, size_t size, char16_t *output,
+                                size_t *outputSize, bool flush)
+{
+    auto inptr = reinterpret_cast<const uchar *>(data);
+    const uchar *inend = inptr + size;
+    char16_t *outptr = output;
+
+    while (inptr < inend) {
+        if (*inptr < 0x80) {
+            const size_t count = widenAscii(inptr, inend - inptr, outptr);
+            inptr += count;
+            outptr += count;
+            continue;
+        }
+
+        // Fast path for well-formed sequences from the BMP, which covers
+        // nearly all non-ASCII text
+        if (inend - inptr >= 3) {
+            const uchar lead = inptr[0];
+            if (lead >= 0xC2 && lead <= 0xDF && (inptr[1] & 0xC0) == 0x80) {
+                *outptr++ = static_cast<char16_t>(((lead & 0x1F) << 6) | (inptr[1] & 0x3F));
+                inptr += 2;
+                continue;
+            }
+            if (lead >= 0xE1 && lead <= 0xEF && lead != 0xED
+                    && (inptr[1] & 0xC0) == 0x80 && (inptr[2] & 0xC0) == 0x80) {
+                *outptr++ = static_cast<char16_t>(((lead & 0x0F) << 12)
+                                                  | ((inptr[1] & 0x3F) << 6)
+                                                  | (inptr[2] & 0x3F));
+                inptr += 3;
+                continue;
+            }
+        }
+
+        uint32_t ch = 0;
+        bool truncated = false;
+        const int length = scanUtf8Sequence(inptr, inend, &ch, &truncated);
+        if (length > 0) {
+            if (ch >= 0x10000) {
+                ch -= 0x10000;
+                *outptr++ = static_cast<char16_t>(0xD800 | (ch >> 10));
+                *outptr++ = static_cast<char16_t>(0xDC00 | (ch & 0x3FF));
+            } else {
+                *outptr++ = static_cast<char16_t>(ch);
+            }
+            inptr += length;
+        } else {
+            // Leave an incomplete final sequence for the next call
+            if (truncated && !flush)
+                break;
+            *outptr++ = REPLACEMENT_CHAR;
+            inptr -= length;
+        }
+    }
+
+    *outputSize = static_cast<size_t>(outptr - output);
+    return static_cast<size_t>(inptr - reinterpret_cast<const uchar *>(data));
+}
+
+size_t TextKernels::utf8Utf16Length(const char *data, size_t size)
+{
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    const uchar *end = bytes + size;
+    size_t pos = 0;
+    size_t length = 0;
+    while (pos < size) {
+        const size_t asciiLength = asciiPrefixLength(data + pos, size - pos);
+        pos += asciiLength;
+        length += asciiLength;
+
+        while (pos < size && bytes[pos] >= 0x80) {
+            uint32_t ch = 0;
+            bool truncated = false;
+            const int sequenceLength = scanUtf8Sequence(bytes + pos, end, &ch, &truncated);
+            if (sequenceLength > 0) {
+                length += (ch >= 0x10000) ? 2 : 1;
+                pos += sequenceLength;
+            } else {
+                // One U+FFFD for each maximal subpart
+                length += 1;
+                pos -= sequenceLength;
+            }
+        }
+    }
+    return length;
+}
+
+size_t TextKernels::utf8ValidLength(const char *data, size_t size, bool flush)
+{
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    const uchar *end = bytes + size;
+    size_t pos = 0;
+    while (pos < size) {
+        pos += asciiPrefixLength(data + pos, size - pos);
+        if (pos >= size)
+            break;
+
+        // Check multi-byte sequences one at a time until we get back to ASCII
+        while (pos < size && bytes[pos] >= 0x80) {
+            if (size - pos >= 3) {
+                const uchar lead = bytes[pos];
+                if (lead >= 0xC2 && lead <= 0xDF && (bytes[pos + 1] & 0xC0) == 0x80) {
+                    pos += 2;
+                    continue;
+                }
+                if (lead >= 0xE1 && lead <= 0xEF && lead != 0xED
+                        && (bytes[pos + 1] & 0xC0) == 0x80 && (bytes[pos + 2] & 0xC0) == 0x80) {
+                    pos += 3;
+                    continue;
+                }
+            }
+
+            uint32_t ch;
+            bool truncated = false;
+            const int length = scanUtf8Sequence(bytes + pos, end, &ch, &truncated);
+            if (length < 0)
+                return (truncated && !flush) ? size : pos;
+            pos += length;
+        }
+    }
+    return size;
+}
+
+void TextKernels::latin1ToUtf16(const char *data, size_t size, char16_t *output,
+                                unsigned maxChar)
+{
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    size_t pos = 0;
+    if (maxChar >= 0xFF) {
+#ifdef SIMDSUPPORT_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for ( ; pos + 16 <= size; pos += 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + pos));
+            auto out = reinterpret_cast<__m128i *>(output + pos);
+            _mm_storeu_si128(out, _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(chunk, zero));
+        }
+#endif
+        for ( ; pos < size; ++pos)
+            output[pos] = bytes[pos];
+        return;
+    }
+
+    while (pos < size) {
+        pos += widenAscii(bytes + pos, size - pos, output + pos);
+        for ( ; pos < size && bytes[pos] >= 0x80; ++pos)
+            output[pos] = (bytes[pos] <= maxChar) ? bytes[pos] : REPLACEMENT_CHAR;
+    }
+}
+
+static inline bool isHighSurrogate(char16_t ch) { return (ch & 0xFC00) == 0xD800; }
+static inline bool isLowSurrogate(char16_t ch) { return (ch & 0xFC00) == 0xDC00; }
+
+static inline char *putUtf8(char *outptr, uint32_t ch)
+{
+    if (ch < 0x80) {
+        *outptr++ = static_cast<char>(ch);
+    } else if (ch < 0x800) {
+        *outptr++ = static_cast<char>(0xC0 | (ch >> 6));
+        *outptr++ = static_cast<char>(0x80 | (ch & 0x3F));
+    } else if (ch < 0x10000) {
+        *outptr++ = static_cast<char>(0xE0 | (ch >> 12));
+        *outptr++ = static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        *outptr++ = static_cast<char>(0x80 | (ch & 0x3F));
+    } else {
+        *outptr++ = static_cast<char>(0xF0 | (ch >> 18));
+        *outptr++ = static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+        *outptr++ = static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        *outptr++ = static_cast<char>(0x80 | (ch & 0x3F));
+    }
+    return outptr;
+}
+
+static inline uint32_t surrogatePair(char16_t high, char16_t low)
+{
+    return 0x10000 + ((static_cast<uint32_t>(high) - 0xD800) << 10)
+                   + (static_cast<uint32_t>(low) - 0xDC00);
+}
+
+// Narrows 16 code units at a time as long as none of them have any of the
+// bits in highMask set.  Returns the number of units converted.
+static inline size_t narrowUnits(const char16_t *text, size_t size, char *output,
+                                 uint16_t highMask)
+{
+    size_t pos = 0;
+#ifdef SIMDSUPPORT_SSE2
+    const __m128i mask = _mm_set1_epi16(static_cast<short>(highMask));
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; pos + 16 <= size; pos += 16) {
+        auto in = reinterpret_cast<const __m128i *>(text + pos);
+        const __m128i lo = _mm_loadu_si128(in);
+        const __m128i hi = _mm_loadu_si128(in + 1);
+        const __m128i high = _mm_and_si128(_mm_or_si128(lo, hi), mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF)
+            break;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + pos), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for ( ; pos < size; ++pos) {
+        if (text[pos] & highMask)
+            break;
+        output[pos] = static_cast<char>(text[pos]);
+    }
+    return pos;
+}
+
+size_t TextKernels::utf16ToUtf8(const char16_t *text, size_t size, char *output,
+                                char16_t *pendingSurrogate, bool flush)
+{
+    char *outptr = output;
+    size_t pos = 0;
+
+    if (*pendingSurrogate) {
+        if (size > 0 && isLowSurrogate(text[0])) {
+            outptr = putUtf8(outptr, surrogatePair(*pendingSurrogate, text[0]));
+            pos = 1;
+        } else if (size > 0 || flush) {
+            outptr = putUtf8(outptr, REPLACEMENT_CHAR);
+        } else {
+            return 0;
+        }
+        *pendingSurrogate = 0;
+    }
+
+    while (pos < size) {
+        const size_t count = narrowUnits(text + pos, size - pos, outptr, 0xFF80);
+        pos += count;
+        outptr += count;
+
+        for ( ; pos < size && text[pos] >= 0x80; ++pos) {
+            const char16_t ch = text[pos];
+            if (isHighSurrogate(ch)) {
+                if (pos + 1 < size) {
+                    if (isLowSurrogate(text[pos + 1])) {
+                        outptr = putUtf8(outptr, surrogatePair(ch, text[pos + 1]));
+                        ++pos;
+                    } else {
+                        outptr = putUtf8(outptr, REPLACEMENT_CHAR);
+                    }
+                } else if (flush) {
+                    outptr = putUtf8(outptr, REPLACEMENT_CHAR);
+                } else {
+                    *pendingSurrogate = ch;
+                }
+            } else if (isLowSurrogate(ch)) {
+                outptr = putUtf8(outptr, REPLACEMENT_CHAR);
+            } else {
+                outptr = putUtf8(outptr, ch);
+            }
+        }
+    }
+
+    return static_cast<size_t>(outptr - output);
+}
+
+// ICU's substitution callback silently drops unmappable characters that
+// are Default_Ignorable_Code_Point, rather than replacing them.
+static inline bool isDefaultIgnorable(uint32_t ch)
+{
+    return ch == 0x00AD || ch == 0x034F || ch == 0x061C
+        || ch == 0x115F || ch == 0x1160
+        || (ch >= 0x17B4 && ch <= 0x17B5)
+        || (ch >= 0x180B && ch <= 0x180F)
+        || (ch >= 0x200B && ch <= 0x200F)
+        || (ch >= 0x202A && ch <= 0x202E)
+        || (ch >= 0x2060 && ch <= 0x206F)
+        || ch == 0x3164
+        || (ch >= 0xFE00 && ch <= 0xFE0F)
+        || ch == 0xFEFF || ch == 0xFFA0
+        || (ch >= 0xFFF0 && ch <= 0xFFF8)
+        || (ch >= 0x1BCA0 && ch <= 0x1BCA3)
+        || (ch >= 0x1D173 && ch <= 0x1D17A)
+        || (ch >= 0xE0000 && ch <= 0xE0FFF);
+}
+
+// Shared by the single-byte encoders.  Runs of code units with none of the
+// bits in directMask set are copied straight to the output (a zero mask
+// disables this).  Everything else goes through lookup(), which returns the
+// encoded byte, or -1 if the character is unmappable.
+template <typename Lookup>
+static size_t encodeSingleByte(const char16_t *text, size_t size, char *output,
+                               char16_t *pendingSurrogate, bool flush,
+                               uint16_t directMask, char substitute, Lookup lookup)
+{
+    char *outptr = output;
+    size_t pos = 0;
+
+    if (*pendingSurrogate) {
+        if (size > 0 && isLowSurrogate(text[0])) {
+            if (!isDefaultIgnorable(surrogatePair(*pendingSurrogate, text[0])))
+                *outptr++ = substitute;
+            pos = 1;
+        } else if (size > 0 || flush) {
+            *outptr++ = substitute;
+        } else {
+            return 0;
+        }
+        *pendingSurrogate = 0;
+    }
+
+    while (pos < size) {
+        if (directMask) {
+            const size_t count = narrowUnits(text + pos, size - pos, outptr, directMask);
+            pos += count;
+            outptr += count;
+        }
+
+        for ( ; pos < size && (!directMask || (text[pos] & directMask)); ++pos) {
+            uint32_t ch = text[pos];
+            if (isHighSurrogate(ch)) {
+                if (pos + 1 < size) {
+                    // A surrogate pair is still only one unmappable character
+                    if (isLowSurrogate(text[pos + 1])) {
+                        ch = surrogatePair(ch, text[pos + 1]);
+                        ++pos;
+                    }
+                } else if (!flush) {
+                    *pendingSurrogate = ch;
+                    return static_cast<size_t>(outptr - output);
+                }
+            } else if (!isLowSurrogate(ch)) {
+                const int mapped = lookup(static_cast<char16_t>(ch));
+                if (mapped >= 0) {
+                    *outptr++ = static_cast<char>(mapped);
+                    continue;
+                }
+            }
+            if (!isDefaultIgnorable(ch))
+                *outptr++ = substitute;
+        }
+    }
+
+    return static_cast<size_t>(outptr - output);
+}
+
+size_t TextKernels::utf16ToLatin1(const char16_t *text, size_t size, char *output,
+                                  char16_t *pendingSurrogate, bool flush,
+                                  unsigned maxChar)
+{
+    const uint16_t highMask = (maxChar >= 0xFF) ? 0xFF00 : 0xFF80;
+    return encodeSingleByte(text, size, output, pendingSurrogate, flush, highMask,
+                            SUBSTITUTE_BYTE, [](char16_t) { return -1; });
+}
+
+void TextKernels::singleByteToUtf16(const char *data, size_t size, char16_t *output,
+                                    const SingleByteTable &table)
+{
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    const char16_t *map = table.toUnicode;
+    size_t pos = 0;
+#ifdef SIMDSUPPORT_SSE2
+    // Blocks of pure ASCII are just widened; anything else is looked up one
+    // byte at a time.  Checking whole blocks keeps the branches predictable
+    // on text that mixes ASCII with letters from the upper half.
+    if (table.asciiIdentity) {
+        const __m128i zero = _mm_setzero_si128();
+        for ( ; pos + 16 <= size; pos += 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + pos));
+            if (_mm_movemask_epi8(chunk) == 0) {
+                auto out = reinterpret_cast<__m128i *>(output + pos);
+                _mm_storeu_si128(out, _mm_unpacklo_epi8(chunk, zero));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(chunk, zero));
+            } else {
+                for (size_t i = 0; i < 16; i += 4) {
+                    output[pos + i] = map[bytes[pos + i]];
+                    output[pos + i + 1] = map[bytes[pos + i + 1]];
+                    output[pos + i + 2] = map[bytes[pos + i + 2]];
+                    output[pos + i + 3] = map[bytes[pos + i + 3]];
+                }
+            }
+        }
+    }
+#endif
+    for ( ; pos + 4 <= size; pos += 4) {
+        output[pos] = map[bytes[pos]];
+        output[pos + 1] = map[bytes[pos + 1]];
+        output[pos + 2] = map[bytes[pos + 2]];
+        output[pos + 3] = map[bytes[pos + 3]];
+    }
+    for ( ; pos < size; ++pos)
+        output[pos] = map[bytes[pos]];
+}
+
+size_t TextKernels::singleByteValidLength(const char *data, size_t size,
+                                          const SingleByteTable &table)
+{
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    size_t pos = 0;
+    while (pos < size) {
+        if (table.asciiIdentity)
+            pos += asciiPrefixLength(data + pos, size - pos);
+        for ( ; pos < size && (bytes[pos] >= 0x80 || !table.asciiIdentity); ++pos) {
+            if (table.invalid[bytes[pos]])
+                return pos;
+        }
+    }
+    return size;
+}
+
+size_t TextKernels::utf16ToSingleByte(const char16_t *text, size_t size, char *output,
+                                      char16_t *pendingSurrogate, bool flush,
+                                      const SingleByteTable &table)
+{
+    const unsigned char *pages = table.fromUnicode.data();
+    const unsigned *pageOffset = table.pageOffset;
+    return encodeSingleByte(text, size, output, pendingSurrogate, flush,
+                            table.asciiIdentity ? 0xFF80 : 0, table.substitute,
+                            [pages, pageOffset](char16_t ch) {
+        const unsigned char mapped = pages[pageOffset[ch >> 8] + (ch & 0xFF)];
+        return (mapped || ch == 0) ? static_cast<int>(mapped) : -1;
+    });
+}
+
+size_t TextKernels::utf16ValidLength(const char16_t *text, size_t size)
+{
+    for (size_t pos = 0; pos < size; ++pos) {
+        const char16_t ch = text[pos];
+        if ((ch & 0xF800) != 0xD800)
+            continue;
+        if (isLowSurrogate(ch) || pos + 1 >= size || !isLowSurrogate(text[pos + 1]))
+            return pos;
+        ++pos;
+    }
+    return size;
+}
+
+// Shared by the encodable length checks.  isMapped() is only called for
+// BMP characters that aren't surrogates.  Like ICU, unmappable characters
+// that are Default_Ignorable_Code_Point don't count, since they would just
+// be dropped instead of substituted.
+template <typename IsMapped>
+static size_t encodableLength(const char16_t *text, size_t size, size_t pos,
+                              IsMapped isMapped)
+{
+    for ( ; pos < size; ++pos) {
+        uint32_t ch = text[pos];
+        size_t length = 1;
+        if (isHighSurrogate(ch) && pos + 1 < size && isLowSurrogate(text[pos + 1])) {
+            ch = surrogatePair(ch, text[pos + 1]);
+            length = 2;
+        } else if ((ch & 0xF800) == 0xD800) {
+            return pos;
+        } else if (isMapped(static_cast<char16_t>(ch))) {
+            continue;
+        }
+        if (!isDefaultIgnorable(ch))
+            return pos;
+        pos += length - 1;
+    }
+    return size;
+}
+
+size_t TextKernels::latin1EncodableLength(const char16_t *text, size_t size,
+                                          unsigned maxChar)
+{
+    const uint16_t highMask = (maxChar >= 0xFF) ? 0xFF00 : 0xFF80;
+    size_t pos = 0;
+#ifdef SIMDSUPPORT_SSE2
+    const __m128i mask = _mm_set1_epi16(static_cast<short>(highMask));
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; pos + 8 <= size; pos += 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + pos));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chunk, mask), zero)) != 0xFFFF)
+            break;
+    }
+#endif
+    return encodableLength(text, size, pos, [highMask](char16_t ch) {
+        return (ch & highMask) == 0;
+    });
+}
+
+size_t TextKernels::singleByteEncodableLength(const char16_t *text, size_t size,
+                                              const SingleByteTable &table)
+{
+    const unsigned char *pages = table.fromUnicode.data();
+    const unsigned *pageOffset = table.pageOffset;
+    return encodableLength(text, size, 0, [pages, pageOffset](char16_t ch) {
+        return ch == 0 || pages[pageOffset[ch >> 8] + (ch & 0xFF)] != 0;
+    });
+}
+
+// Tracks the state of a line ending scan between blocks
+struct LineScanState
+{
+    TextKernels::LineStats stats;
+    size_t lineStart;
+    size_t resume;      // Skip positions before this (the LF of a CRLF)
+};
+
+static inline void lineBreakAt(LineScanState &state, size_t pos, size_t lineEnd)
+{
+    const size_t length = lineEnd - state.lineStart;
+    if (length > state.stats.longestLine)
+        state.stats.longestLine = length;
+    state.lineStart = pos;
+}
+
+static inline void scanByte(LineScanState &state, const uchar *bytes, size_t size, size_t pos)
+{
+    if (pos < state.resume)
+        return;
+    switch (bytes[pos]) {
+    case '\n':
+        state.stats.lfCount += 1;
+        lineBreakAt(state, pos + 1, pos);
+        break;
+    case '\r':
+        if (pos + 1 < size && bytes[pos + 1] == '\n') {
+            state.stats.crlfCount += 1;
+            lineBreakAt(state, pos + 2, pos);
+            state.resume = pos + 2;
+        } else {
+            state.stats.crCount += 1;
+            lineBreakAt(state, pos + 1, pos);
+        }
+        break;
+    case 0:
+        state.stats.hasNul = true;
+        break;
+    default:
+        break;
+    }
+}
+
+#ifdef SIMDSUPPORT_SSE2
+static inline void scanMask(LineScanState &state, const uchar *bytes, size_t size,
+                            size_t blockStart, unsigned mask)
+{
+    while (mask) {
+        scanByte(state, bytes, size, blockStart + SimdSupport::countTrailingZeros(mask));
+        mask &= mask - 1;
+    }
+}
+#endif
+
+#ifdef SIMDSUPPORT_AVX2
+TARGET_AVX2
+static size_t scanLinesAvx2(LineScanState &state, const uchar *bytes, size_t size)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i zero = _mm256_setzero_si256();
+    size_t pos = 0;
+    for ( ; pos + 32 <= size; pos += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + pos));
+        __m256i match = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr),
+                                        _mm256_cmpeq_epi8(chunk, lf));
+        // Once a NUL has been seen, there's no need to keep looking for them
+        if (!state.stats.hasNul)
+            match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, zero));
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(match));
+        if (mask)
+            scanMask(state, bytes, size, pos, mask);
+    }
+    return pos;
+}
+#endif
+
+static void scanLinesBytes(LineScanState &state, const uchar *bytes, size_t size)
+{
+    size_t pos = 0;
+#ifdef SIMDSUPPORT_AVX2
+    if (s_hasAvx2)
+        pos = scanLinesAvx2(state, bytes, size);
+#endif
+#ifdef SIMDSUPPORT_SSE2
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; pos + 16 <= size; pos += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + pos));
+        __m128i match = _mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, lf));
+        if (!state.stats.hasNul)
+            match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, zero));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(match));
+        if (mask)
+            scanMask(state, bytes, size, pos, mask);
+    }
+#endif
+    for ( ; pos < size; ++pos)
+        scanByte(state, bytes, size, pos);
+}
+
+static inline uint32_t readUnit(const uchar *data, int unitSize, bool bigEndian)
+{
+    uint32_t unit = 0;
+    for (int i = 0; i < unitSize; ++i) {
+        const int shift = bigEndian ? (unitSize - 1 - i) * 8 : i * 8;
+        unit |= static_cast<uint32_t>(data[i]) << shift;
+    }
+    return unit;
+}
+
+static void scanLinesUnits(LineScanState &state, const uchar *bytes, size_t size,
+                           int unitSize, bool bigEndian)
+{
+    const size_t count = size / unitSize;
+    for (size_t pos = 0; pos < count; ++pos) {
+        switch (readUnit(bytes + pos * unitSize, unitSize, bigEndian)) {
+        case '\n':
+            state.stats.lfCount += 1;
+            lineBreakAt(state, pos + 1, pos);
+            break;
+        case '\r':
+            if (pos + 1 < count
+                    && readUnit(bytes + (pos + 1) * unitSize, unitSize, bigEndian) == '\n') {
+                state.stats.crlfCount += 1;
+                lineBreakAt(state, pos + 2, pos);
+                ++pos;
+            } else {
+                state.stats.crCount += 1;
+                lineBreakAt(state, pos + 1, pos);
+            }
+            break;
+        case 0:
+            state.stats.hasNul = true;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void TextKernels::scanLines(const char *data, size_t size, LineStats *stats,
+                            int unitSize, bool bigEndian)
+{
+    LineScanState state;
+    state.stats.crCount = 0;
+    state.stats.lfCount = 0;
+    state.stats.crlfCount = 0;
+    state.stats.longestLine = 0;
+    state.stats.hasNul = false;
+    state.lineStart = 0;
+    state.resume = 0;
+
+    auto bytes = reinterpret_cast<const uchar *>(data);
+    size_t units = size;
+    if (unitSize > 1) {
+        units = size / unitSize;
+        scanLinesUnits(state, bytes, size, unitSize, bigEndian);
+    } else {
+        scanLinesBytes(state, bytes, size);
+    }
+
+    // The last line doesn't have a line ending
+    lineBreakAt(state, units, units);
+    *stats = state.stats;
+}
+
+const char *TextKernels::simdLevel()
+{
+#if defined(SIMDSUPPORT_AVX2)
+    if (s_hasAvx2)
+        return "AVX2";
+#endif
+#if defined(SIMDSUPPORT_SSE2)
+    return "SSE2";
+#else
+    return "Scalar";
+#endif
+}
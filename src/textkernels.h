@@ -0,0 +1,142 @@
+/* This file is part of QTextPad.
+ *
+ * QTextPad is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QTextPad is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QTextPad.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QTEXTPAD_TEXTKERNELS_H
+#define QTEXTPAD_TEXTKERNELS_H
+
+#include <cstddef>
+#include <vector>
+
+// Fast conversion routines for the encodings that make up nearly all of the
+// files we open (UTF-8, US-ASCII, ISO-8859-1 and the other single-byte code
+// pages).  These use SSE2 (and AVX2
+// where the CPU supports it) to handle runs of ASCII text, and a scalar loop
+// for everything else.  Invalid input and unmappable characters are replaced
+// exactly the same way ICU's default callbacks would do it, so the results
+// don't depend on which path was taken.
+//
+// This deliberately has no Qt dependencies, so it can also be built into
+// the benchmark tool.
+namespace TextKernels
+{
+    // Number of leading bytes that are 7-bit ASCII.
+    size_t asciiPrefixLength(const char *data, size_t size);
+
+    // Decode UTF-8 into UTF-16.  The output must have room for at least
+    // size code units.  Each maximal invalid subsequence is replaced with
+    // U+FFFD.  If flush is false, an incomplete sequence at the end of the
+    // input is not consumed, so it can be passed in again with more data.
+    // Returns the number of input bytes consumed.
+    size_t utf8ToUtf16(const char *data, size_t size, char16_t *output,
+                       size_t *outputSize, bool flush);
+
+    // Number of UTF-16 code units utf8ToUtf16() produces for the complete
+    // input (with flush set), without decoding it.
+    size_t utf8Utf16Length(const char *data, size_t size);
+
+    // Returns the length of the initial well-formed UTF-8 portion of data.
+    // If flush is false, an incomplete sequence at the very end of the input
+    // is considered valid.
+    size_t utf8ValidLength(const char *data, size_t size, bool flush);
+
+    // Decode a single-byte encoding whose code points are equal to the byte
+    // values.  Bytes above maxChar (0x7F for US-ASCII, 0xFF for ISO-8859-1)
+    // are replaced with U+FFFD.  The output must have room for size units.
+    void latin1ToUtf16(const char *data, size_t size, char16_t *output,
+                       unsigned maxChar = 0xFF);
+
+    // Encode UTF-16 into UTF-8.  The output must have room for 3 bytes per
+    // input code unit (plus 3 bytes if *pendingSurrogate is set).  A high
+    // surrogate at the end of the input is held in *pendingSurrogate unless
+    // flush is set.  Unpaired surrogates are replaced with U+FFFD.
+    // Returns the number of bytes written.
+    size_t utf16ToUtf8(const char16_t *text, size_t size, char *output,
+                       char16_t *pendingSurrogate, bool flush);
+
+    // Encode UTF-16 into a single-byte encoding whose code points are equal
+    // to the byte values.  Characters above maxChar are replaced with the
+    // ASCII SUB control character, once per code point.  The output must
+    // have room for size bytes (plus one if *pendingSurrogate is set).
+    // Returns the number of bytes written.
+    size_t utf16ToLatin1(const char16_t *text, size_t size, char *output,
+                         char16_t *pendingSurrogate, bool flush,
+                         unsigned maxChar = 0xFF);
+
+    // Lookup tables for a stateless single-byte code page such as
+    // windows-1252 or KOI8-R.  These are filled in by the caller from the
+    // converter's own mappings, including whatever it substitutes for
+    // unassigned bytes.
+    struct SingleByteTable
+    {
+        char16_t toUnicode[256];
+        bool invalid[256];      // Unassigned or illegal bytes
+
+        // Reverse mapping, split into pages of 256 bytes by the high byte of
+        // the code unit.  pageOffset gives the start of each page within
+        // fromUnicode; all of the pages without any mappings share the one
+        // at offset 0.  A zero byte means the character is unmappable,
+        // except on U+0000 itself.
+        unsigned pageOffset[256];
+        std::vector<unsigned char> fromUnicode;
+
+        char substitute;        // Written for unmappable characters
+        bool asciiIdentity;     // 0x00-0x7F map to themselves both ways
+    };
+
+    // Decode a single-byte code page.  The output must have room for size
+    // code units.
+    void singleByteToUtf16(const char *data, size_t size, char16_t *output,
+                           const SingleByteTable &table);
+
+    // Returns the number of leading bytes that are valid in the code page.
+    size_t singleByteValidLength(const char *data, size_t size,
+                                 const SingleByteTable &table);
+
+    // Encode UTF-16 into a single-byte code page, with the same rules for
+    // unmappable characters and surrogates as utf16ToLatin1().
+    size_t utf16ToSingleByte(const char16_t *text, size_t size, char *output,
+                             char16_t *pendingSurrogate, bool flush,
+                             const SingleByteTable &table);
+
+    // Length of the initial part of text that can be encoded without any
+    // substitutions.  Unpaired surrogates can't be encoded anywhere.
+    size_t utf16ValidLength(const char16_t *text, size_t size);
+    size_t latin1EncodableLength(const char16_t *text, size_t size,
+                                 unsigned maxChar = 0xFF);
+    size_t singleByteEncodableLength(const char16_t *text, size_t size,
+                                     const SingleByteTable &table);
+
+    struct LineStats
+    {
+        size_t crCount;         // CR not followed by LF
+        size_t lfCount;         // LF not preceded by CR
+        size_t crlfCount;
+        size_t longestLine;     // In code units, not including the line ending
+        bool hasNul;
+    };
+
+    // Counts line endings and collects a few other statistics about the
+    // text in a single pass.  unitSize is the size of a code unit in bytes
+    // (1 for ASCII-compatible encodings, 2 for UTF-16 or 4 for UTF-32);
+    // only single-byte units use the vector path.
+    void scanLines(const char *data, size_t size, LineStats *stats,
+                   int unitSize = 1, bool bigEndian = false);
+
+    // Name of the instruction set used for the vector paths, for logging.
+    const char *simdLevel();
+}
+
+#endif // QTEXTPAD_TEXTKERNELS_H